@@ -73,20 +73,106 @@ define_system_module tb ../tb/system.cpp ../tb/sc_main.cpp
 ######################################################################
 set DEFAULT_ARGV ""
 
-foreach dma [list 64] {
-    define_io_config * IOCFG_DMA$dma -DDMA_WIDTH=$dma
-
-    define_system_config tb TESTBENCH_DMA$dma -io_config IOCFG_DMA$dma
-
-    define_sim_config "BEHAV_DMA$dma" "gemm_accelerator BEH" "tb TESTBENCH_DMA$dma" -io_config IOCFG_DMA$dma -argv $DEFAULT_ARGV
-
-    foreach cfg [list BASIC] {
-	set cname $cfg\_DMA$dma
-	define_hls_config gemm_accelerator $cname -io_config IOCFG_DMA$dma --clock_period=$CLOCK_PERIOD $COMMON_HLS_FLAGS -DHLS_DIRECTIVES_$cfg
-	if {$TECH_IS_XILINX == 1} {
-	    define_sim_config "$cname\_V" "gemm_accelerator RTL_V $cname" "tb TESTBENCH_DMA$dma" -io_config IOCFG_DMA$dma -argv $DEFAULT_ARGV -verilog_top_modules glbl
+# Regression runs of the optional features, in the positional order of the
+# testbench (see load_memory), with alpha (%d) one in the accumulator format:
+# B with 50% zero tiles and a bias
+set SPARSE_ARGV "256 256 256 0 0 1 0 0 0 0 0 %d 0 1 -1 -1 -1 0 0 0 1 50"
+# 2:4 structured B, on the S24 geometry
+set SPARSE_24_ARGV "128 128 256 0 0 1 0 0 0 0 0 %d 0 1 -1 -1 -1 0 0 0 0 -1 1"
+# A fused chain with a bias and ReLU, on the CH geometry
+set CHAIN_ARGV "200 64 128 0 0 1 1 0 0 0 0 %d 0 1 -1 -1 -1 0 0 0 0 -1 0 1 96"
+# A ring of 4 jobs with a bias, ReLU and beta, notifying the last one only
+set JOBS_ARGV "96 64 80 0 0 1 1 0 0 0 0 %d 3 1 -1 -1 -1 0 0 0 0 -1 0 0 64 4 -1 0"
+
+# Datapath variants: integer (with packed int16/int8), Q-format fixed point,
+# and bfloat16 multiply with fp32 accumulation
+set DATAPATHS [list INT FX BF16]
+
+# Design-space points: BLOCK_SIZE x PLM_PORTS (x PANEL_BLOCKS, COMPUTE_LANES,
+# and S24 for the 2:4 sparse datapath or CH for the fused chain). The first one
+# is the default geometry and keeps the unsuffixed configuration names; the
+# PLMs of every point are listed in memlist.txt
+set GEOMETRIES [list {64 16 4 1} {32 8 4 1} {64 32 4 1} {128 32 2 1} {64 16 4 2} {64 16 4 1 S24} {64 16 4 1 CH}]
+
+# DMA widths: 64 bits for every point, and 128 and 256 bits (4 and 8 words
+# per beat) for the default geometry, for SoCs with a wider NoC
+foreach dma [list 64 128 256] {
+    foreach dp $DATAPATHS {
+	if {$dp eq "INT"} {
+	    set dpname ""
+	    set dpflags ""
 	} else {
-	    define_sim_config "$cname\_V" "gemm_accelerator RTL_V $cname" "tb TESTBENCH_DMA$dma" -io_config IOCFG_DMA$dma -argv $DEFAULT_ARGV
+	    set dpname "_$dp"
+	    set dpflags "-DDATAPATH_$dp"
+	}
+	# 1 in the accumulator format (integer, Q16.16, fp32)
+	set one [dict get {INT 1 FX 65536 BF16 1065353216} $dp]
+	foreach geo $GEOMETRIES {
+	    lassign $geo block ports panel lanes feature
+	    if {$dma != 64 && $geo ne [lindex $GEOMETRIES 0]} {
+		continue
+	    }
+	    # the chain runs on the 32-bit integer and fixed-point datapaths
+	    if {$feature eq "CH" && $dp eq "BF16"} {
+		continue
+	    }
+	    if {$geo eq [lindex $GEOMETRIES 0]} {
+		set geoname ""
+	    } elseif {$lanes == 1} {
+		set geoname "_B${block}P${ports}${feature}"
+	    } else {
+		set geoname "_B${block}P${ports}L${lanes}${feature}"
+	    }
+	    set geoflags "-DBLOCK_SIZE=$block -DPLM_PORTS=$ports -DPANEL_BLOCKS=$panel -DCOMPUTE_LANES=$lanes"
+	    if {$feature eq "S24"} {
+		append geoflags " -DSPARSE_24"
+	    }
+	    if {$feature eq "CH"} {
+		append geoflags " -DGEMM_CHAIN"
+	    }
+
+	    # Compute engines: dot product with adder tree (BASIC), or an
+	    # output-stationary systolic array (SYSTOLIC), which the testbench
+	    # must know about too
+	    foreach cfg [list BASIC SYSTOLIC] {
+		# the systolic array has no lanes, nor the 2:4 datapath
+		if {$cfg eq "SYSTOLIC" && ($lanes != 1 || $feature eq "S24")} {
+		    continue
+		}
+		if {$cfg eq "BASIC"} {
+		    set engname ""
+		    set engflags ""
+		} else {
+		    set engname "_$cfg"
+		    set engflags "-DCOMPUTE_$cfg"
+		}
+		set iocfg IOCFG$engname$dpname$geoname\_DMA$dma
+		set tbcfg TESTBENCH$engname$dpname$geoname\_DMA$dma
+
+		define_io_config * $iocfg -DDMA_WIDTH=$dma $dpflags $geoflags $engflags
+
+		define_system_config tb $tbcfg -io_config $iocfg
+
+		define_sim_config "BEHAV$engname$dpname$geoname\_DMA$dma" "gemm_accelerator BEH" "tb $tbcfg" -io_config $iocfg -argv $DEFAULT_ARGV
+		if {$geo eq [lindex $GEOMETRIES 0]} {
+		    define_sim_config "BEHAV$engname$dpname$geoname\_DMA$dma\_SPB" "gemm_accelerator BEH" "tb $tbcfg" -io_config $iocfg -argv [format $SPARSE_ARGV $one]
+		    define_sim_config "BEHAV$engname$dpname$geoname\_DMA$dma\_JOBS" "gemm_accelerator BEH" "tb $tbcfg" -io_config $iocfg -argv [format $JOBS_ARGV $one]
+		}
+		if {$feature eq "S24"} {
+		    define_sim_config "BEHAV$engname$dpname$geoname\_DMA$dma\_SP24" "gemm_accelerator BEH" "tb $tbcfg" -io_config $iocfg -argv [format $SPARSE_24_ARGV $one]
+		}
+		if {$feature eq "CH"} {
+		    define_sim_config "BEHAV$engname$dpname$geoname\_DMA$dma\_CHAIN" "gemm_accelerator BEH" "tb $tbcfg" -io_config $iocfg -argv [format $CHAIN_ARGV $one]
+		}
+
+		set cname $cfg$dpname$geoname\_DMA$dma
+		define_hls_config gemm_accelerator $cname -io_config $iocfg --clock_period=$CLOCK_PERIOD $COMMON_HLS_FLAGS -DHLS_DIRECTIVES_$cfg
+		if {$TECH_IS_XILINX == 1} {
+		    define_sim_config "$cname\_V" "gemm_accelerator RTL_V $cname" "tb $tbcfg" -io_config $iocfg -argv $DEFAULT_ARGV -verilog_top_modules glbl
+		} else {
+		    define_sim_config "$cname\_V" "gemm_accelerator RTL_V $cname" "tb $tbcfg" -io_config $iocfg -argv $DEFAULT_ARGV
+		}
+	    }
 	}
     }
 }
@@ -17,7 +17,18 @@ void gemm_accelerator::load_input()
     {
         HLS_PROTO("load-reset");
 
-        this->reset_load_input();
+        this->input_ready.req.reset_req();
+        this->dma_read_chnl.reset_get();
+#if DMA_READ_AHEAD > 0
+        // the DMA read requests are issued by load_request
+        this->read_queue.reset_put();
+#else
+        this->dma_read_ctrl.reset_put();
+#endif
+        this->read_beats.write(0);
+        this->compute_jobs.reset_put();
+        this->store_jobs.reset_put();
+        this->load_state.write(PROC_IDLE);
 
         // explicit PLM ports reset if any
 
@@ -31,88 +42,298 @@ void gemm_accelerator::load_input()
     int32_t gemm_m;
     int32_t gemm_n;
     int32_t gemm_k;
+    int32_t transpose_b;
+    int32_t precision;
+    int32_t bias;
+    int32_t activation;
+    int32_t clamp_min;
+    int32_t clamp_max;
+    int32_t rq_scale;
+    int32_t rq_shift;
+    int32_t alpha;
+    int32_t beta;
+    int32_t batch_count;
+    int32_t stride_a;
+    int32_t stride_b;
+    int32_t stride_c;
+    int32_t lda;
+    int32_t ldb;
+    int32_t ldc;
+    int32_t a_offset;
+    int32_t b_offset;
+    int32_t c_offset;
+    int32_t sparse_b;
+    int32_t sparse_24;
+    int32_t perf;
+    int32_t chain;
+    int32_t gemm_p;
+    int32_t b2_offset;
+    int32_t jobs;
+    int32_t desc_offset;
+    int32_t notify;
+    conf_info_t config;
     {
         HLS_PROTO("load-config");
 
         cfg.wait_for_config(); // config process
-        conf_info_t config = this->conf_info.read();
+        config = this->conf_info.read();
 
-        // User-defined config code
-        /* <<--local-params-->> */
-        gemm_m = config.gemm_m;
-        gemm_n = config.gemm_n;
-        gemm_k = config.gemm_k;
+        jobs = config.jobs;
+        desc_offset = config.desc_offset;
+        notify = config.notify;
     }
 
-    // Load
+    // Kept across the jobs, so that the PLM buffers and slots keep alternating
+    // (the panels are counted across batches too, see panel_slot)
+    bool ping = true;
+    uint32_t bias_slot = 0;
+    uint32_t num_panel = 0;
+
+    // The jobs of the ring go through the pipeline back to back
+    for (uint32_t job = 0; job < (jobs ? jobs : 1); job++)
     {
-        HLS_PROTO("load-dma");
-        wait();
+        {
+            HLS_PROTO("load-job");
 
-        bool ping = true;
+            // the descriptor of the job, passed on to the other processes
+            if (jobs)
+            {
+                load_desc(desc_offset + (job * DESC_WORDS), config);
+                compute_jobs.put(config);
+                store_jobs.put(config);
+            }
 
-        // Moving in M dimension for matrix 1, and moving to new row of output
-        for (uint32_t num_m = 0; num_m < gemm_m/BLOCK_SIZE; num_m++)
+            // User-defined config code
+            /* <<--local-params-->> */
+            gemm_m = config.gemm_m;
+            gemm_n = config.gemm_n;
+            gemm_k = config.gemm_k;
+            transpose_b = config.transpose_b;
+            precision = config.precision;
+            bias = config.bias;
+            activation = config.activation;
+            clamp_min = config.clamp_min;
+            clamp_max = config.clamp_max;
+            rq_scale = config.rq_scale;
+            rq_shift = config.rq_shift;
+            alpha = config.alpha;
+            beta = config.beta;
+            batch_count = config.batch_count;
+            stride_a = config.stride_a;
+            stride_b = config.stride_b;
+            stride_c = config.stride_c;
+            lda = config.lda;
+            ldb = config.ldb;
+            ldc = config.ldc;
+            a_offset = config.a_offset;
+            b_offset = config.b_offset;
+            c_offset = config.c_offset;
+            sparse_b = config.sparse_b;
+            sparse_24 = config.sparse_24;
+            perf = config.perf;
+            chain = config.chain;
+            gemm_p = config.gemm_p;
+            b2_offset = config.b2_offset;
+        }
+
+#if !defined(GEMM_CHAIN)
+        // no fused chain in this configuration
+        chain = 0;
+#endif
+
+        // The chain runs a single int32 GEMM, without C input nor sparse B
+        if (chain)
+        {
+            precision = PRECISION_INT32;
+            beta = 0;
+            batch_count = 1;
+            sparse_b = 0;
+            sparse_24 = 0;
+            // a whole row of blocks of A x B is kept in plm_mid
+            if (gemm_n > BLOCK_SIZE)
+                gemm_n = BLOCK_SIZE;
+        }
+
+        // K is counted in PLM words, each packing 1, 2 or 4 elements
+        int32_t log2_lanes = datapath_t::log2_lanes(precision);
+        int32_t gemm_kw = (gemm_k + (1 << log2_lanes) - 1) >> log2_lanes;
+
+#if !defined(SPARSE_24)
+        // no 2:4 datapath in this configuration
+        sparse_24 = 0;
+#endif
+
+        // A 2:4 compressed B is always stored N x K, SPARSE_24_WORDS per K block
+        if (sparse_24)
+            transpose_b = 0;
+
+        // Row pitches in words, 0 for packed rows: A is M x K, B is N x K (K x N
+        // with transpose_b) and C is M x N
+        if (lda == 0)
+            lda = gemm_kw;
+        if (ldb == 0 && sparse_24)
+            ldb = ((gemm_kw + BLOCK_SIZE - 1) / BLOCK_SIZE) * SPARSE_24_WORDS;
+        else if (ldb == 0)
+            ldb = transpose_b ? gemm_n : gemm_kw;
+        if (ldc == 0)
+            ldc = gemm_n;
+
+        // Load
         {
+            HLS_PROTO("load-dma");
+            load_state.write(PROC_BUSY);
             wait();
-            // Moving in N dimension for matrix 2, and moving to new column of output
-            for (uint32_t num_n = 0; num_n < gemm_n/BLOCK_SIZE; num_n++)
+
+            // The input PLMs, panel slots and bitmap of the previous job are
+            // free once compute_kernel is done with it
+            if (job > 0)
+                load_compute_sync();
+
+            uint32_t N_BLOCK_M = (gemm_m + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            uint32_t N_BLOCK_N = (gemm_n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            uint32_t N_BLOCK_K = (gemm_kw + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+            // The operand with fewer panels (A if it has no more row panels than B
+            // has column panels) is stationary: its 64xK panel stays in plm_panel
+            // across the inner loop, while the other operand streams through the
+            // ping-pong PLM. With chain, A is stationary, so that a block row of
+            // A x B is done before its blocks of B2 (the same in every process)
+            bool b_stationary = !chain && N_BLOCK_N < N_BLOCK_M;
+            bool panel_fits = N_BLOCK_K <= PANEL_BLOCKS;
+            uint32_t N_BLOCK_OUTER = b_stationary ? N_BLOCK_N : N_BLOCK_M;
+            uint32_t N_BLOCK_INNER = b_stationary ? N_BLOCK_M : N_BLOCK_N;
+
+            // A, B and C are placed independently; the bias vector follows the B
+            // matrices (B2 with chain), starting at the next DMA beat boundary.
+            // There is no offset register for the bias or the bitmap: software
+            // must place them right after B (see the README)
+            uint32_t offset_bias = round_up(b_offset + ((batch_count - 1) * stride_b) +
+                                            ((transpose_b ? gemm_kw : gemm_n) * ldb), DMA_WORD_PER_BEAT);
+            if (chain)
+                offset_bias = round_up(b2_offset + (gemm_p * gemm_n), DMA_WORD_PER_BEAT);
+            uint32_t N_BLOCK_P = (gemm_p + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+            // The tile bitmap of B (shared by the batch) follows the bias, beat
+            // aligned, and is read once before the first step
+            if (sparse_b)
             {
-                wait();
-                // Moving in K dimension for both matrices to fully compute output
-                for (uint32_t num_k = 0; num_k < gemm_k/BLOCK_SIZE; num_k++)
+                uint32_t offset_bitmap = round_up(offset_bias + (bias ? gemm_n : 0), DMA_WORD_PER_BEAT);
+
+                load_bitmap(offset_bitmap, ((N_BLOCK_N * N_BLOCK_K) + 31) / 32);
+                load_compute_sync();
+            }
+
+            // The batches go through the same pipeline, without draining it in between
+            for (uint32_t batch = 0; batch < batch_count; batch++)
+            {
+                // Moving along the stationary operand, and moving to new row (or column) of output
+                for (uint32_t num_outer = 0; num_outer < N_BLOCK_OUTER; num_outer++)
                 {
                     wait();
-                    // read the two 64x64 blocks from matrix 1 & 2 - only offset's change depending on 
-                    // position in outer loops
-                    for (uint32_t mat_num = 0; mat_num < 2; mat_num++)
+                    // Moving along the streamed operand, and moving to new column (or row) of output
+                    for (uint32_t num_inner = 0; num_inner < N_BLOCK_INNER; num_inner++)
                     {
-                        uint32_t offset;
+                        uint32_t num_m = b_stationary ? num_inner : num_outer;
+                        uint32_t num_n = b_stationary ? num_outer : num_inner;
+                        uint32_t rows_a = block_extent(gemm_m, num_m);
+                        uint32_t rows_b = block_extent(gemm_n, num_n);
 
                         wait();
 
-                        // offset from start + vertical offset + horizontal offset
-                        if (mat_num)
-                            offset = (gemm_m * gemm_k) + (num_n * BLOCK_SIZE * gemm_k) + (num_k * BLOCK_SIZE);
-                        else
-                            offset = (num_m * BLOCK_SIZE * gemm_k) + (num_k * BLOCK_SIZE);
-                    
-                        // each new row of the block
-                        for (uint32_t row_num = 0; row_num < BLOCK_SIZE; row_num++)
+                        // the bias slice of this output block, for the store epilogue
+                        // (of the blocks of D with chain, see below)
+                        if (!chain)
                         {
-                            wait();
-
-                            dma_info_t dma_info(offset / DMA_WORD_PER_BEAT, BLOCK_SIZE / DMA_WORD_PER_BEAT, DMA_SIZE);
-                            this->dma_read_ctrl.put(dma_info);
-                            offset += gemm_k;
+                            if (bias)
+                                load_bias(offset_bias + (num_n * BLOCK_SIZE), rows_b, bias_slot);
+                            bias_slot = (bias_slot == BIAS_SLOTS - 1) ? 0 : bias_slot + 1;
+                        }
 
-                            for (uint32_t i = 0; i < BLOCK_SIZE; i += DMA_WORD_PER_BEAT)
+                        // Moving in K dimension for both matrices to fully compute output
+                        bool stepped = false;
+                        for (uint32_t num_k = 0; num_k < N_BLOCK_K; num_k++)
+                        {
+                            // the steps of the all-zero tiles of B are skipped, in the
+                            // same way by compute_kernel
+                            bool tile_nz = !sparse_b || tile_nonzero(BITMAP_LOAD, N_BLOCK_K, num_n, num_k);
+                            if (step_needed(tile_nz, bias && !stepped, b_stationary, N_BLOCK_K, N_BLOCK_INNER, num_inner, num_k))
                             {
-                                HLS_BREAK_DEP(plm_in_ping);
-                                HLS_BREAK_DEP(plm_in_pong);
+                                stepped = true;
+
+                                // offset from start + vertical offset + horizontal offset; B is
+                                // either stored transposed (N x K) or row-major (K x N)
+                                uint32_t offset_a = a_offset + (batch * stride_a) + (num_m * BLOCK_SIZE * lda) + (num_k * BLOCK_SIZE);
+                                uint32_t offset_b = b_offset + (batch * stride_b);
+                                if (transpose_b)
+                                    offset_b += (num_k * BLOCK_SIZE * ldb) + (num_n * BLOCK_SIZE);
+                                else
+                                    offset_b += (num_n * BLOCK_SIZE * ldb) + (num_k * (sparse_24 ? SPARSE_24_WORDS : BLOCK_SIZE));
+                                uint32_t cols = block_extent(gemm_kw, num_k);
+                                uint32_t cols_b = sparse_24 ? SPARSE_24_WORDS : cols;
+                                uint32_t slot = panel_slot(N_BLOCK_K, num_panel, num_k, ping);
 
-                                sc_dt::sc_bv<DMA_WIDTH> dataBv;
-
-                                dataBv = this->dma_read_chnl.get();
                                 wait();
 
-                                // Write to PLM (all DMA_WORD_PER_BEAT words in one cycle)
-                                for (uint32_t k = 0; k < DMA_WORD_PER_BEAT; k++)
+                                // the stationary block is only fetched on the first pass over
+                                // the panel, unless the panel does not fit in the PLM. A step
+                                // kept for a zero tile only fetches the A panel block
+                                if (num_inner == 0 || !panel_fits)
                                 {
-                                    uint32_t plm_index = (mat_num * (PLM_IN_WORD/2)) + (row_num * BLOCK_SIZE) + i + k;
-                                    HLS_UNROLL_SIMPLE;
-                                    if (ping)
-                                        plm_in_ping[plm_index] = dataBv.range((k+1) * DATA_WIDTH - 1, k * DATA_WIDTH).to_int64();
+                                    if (!b_stationary)
+                                        load_block(offset_a, lda, rows_a, cols, false, true, slot, ping);
+                                    else if (tile_nz)
+                                        load_block(offset_b, ldb, rows_b, cols_b, transpose_b, true, slot, ping);
+                                }
+
+                                if (tile_nz)
+                                {
+                                    if (b_stationary)
+                                        load_block(offset_a, lda, rows_a, cols, false, false, slot, ping);
                                     else
-                                        plm_in_pong[plm_index] = dataBv.range((k+1) * DATA_WIDTH - 1, k * DATA_WIDTH).to_int64();
+                                        load_block(offset_b, ldb, rows_b, cols_b, transpose_b, false, slot, ping);
                                 }
+
+                                load_compute_sync();
+                                ping = !ping;
                             }
                         }
+
+                        // one more step after the last K block: the C tile goes through the
+                        // ping/pong PLM, to be scaled and added to the output block
+                        if (beta != 0)
+                        {
+                            uint32_t offset_tile = c_offset + (batch * stride_c) + (num_m * BLOCK_SIZE * ldc) + (num_n * BLOCK_SIZE);
+
+                            load_block(offset_tile, ldc, rows_a, rows_b, false, false, 0, ping);
+
+                            load_compute_sync();
+                            ping = !ping;
+                        }
+
+                        // With chain, this block of A x B is a row of blocks of the
+                        // intermediate: one more step per block of B2 (packed rows of
+                        // gemm_n words), each making a block of D
+                        for (uint32_t num_p = 0; chain && num_p < N_BLOCK_P; num_p++)
+                        {
+                            uint32_t rows_b2 = block_extent(gemm_p, num_p);
+
+                            wait();
+
+                            if (bias)
+                                load_bias(offset_bias + (num_p * BLOCK_SIZE), rows_b2, bias_slot);
+                            bias_slot = (bias_slot == BIAS_SLOTS - 1) ? 0 : bias_slot + 1;
+
+                            load_block(b2_offset + (num_p * BLOCK_SIZE * gemm_n), gemm_n, rows_b2, gemm_n,
+                                       false, false, 0, ping);
+
+                            load_compute_sync();
+                            ping = !ping;
+                        }
                     }
-                    this->load_compute_handshake();
-                    ping = !ping;
+                    num_panel++;
                 }
             }
+            load_state.write(PROC_IDLE);
         }
     }
 
@@ -124,6 +345,94 @@ void gemm_accelerator::load_input()
 
 
 
+#if DMA_READ_AHEAD > 0
+void gemm_accelerator::load_request()
+{
+    // Reset
+    {
+        HLS_PROTO("request-reset");
+
+        this->dma_read_ctrl.reset_put();
+        this->read_queue.reset_get();
+
+        wait();
+    }
+
+    // Hand the queued requests to the DMA in order. The DMA may only take a
+    // request once it has sent the data of the previous one, so this process
+    // waits for it while load_input keeps draining the data
+    while (true)
+    {
+        HLS_PROTO("request-dma");
+
+        dma_info_t dma_info = this->read_queue.get();
+
+        wait();
+        this->dma_read_ctrl.put(dma_info);
+    }
+}
+#endif
+
+
+
+void gemm_accelerator::perf_counters()
+{
+    // Reset
+    {
+        HLS_PROTO("perf-reset");
+
+        for (uint32_t i = 0; i < PERF_CYCLE_WORDS; i++)
+        {
+            HLS_UNROLL_SIMPLE;
+            this->perf_cycles[i].write(0);
+        }
+
+        wait();
+    }
+
+    uint32_t load_busy = 0;
+    uint32_t load_wait_compute = 0;
+    uint32_t compute_busy = 0;
+    uint32_t compute_wait_load = 0;
+    uint32_t compute_wait_store = 0;
+    uint32_t store_busy = 0;
+
+    // One sample of the process states per cycle, until the next reset (store
+    // waiting for compute_kernel counts as idle)
+    while (true)
+    {
+        HLS_PROTO("perf-count");
+
+        wait();
+
+        sc_dt::sc_uint<2> load = load_state.read();
+        sc_dt::sc_uint<2> compute = compute_state.read();
+        sc_dt::sc_uint<2> store = store_state.read();
+
+        if (load == PROC_BUSY)
+            load_busy++;
+        if (load == PROC_WAIT_NEXT)
+            load_wait_compute++;
+        if (compute == PROC_BUSY)
+            compute_busy++;
+        if (compute == PROC_WAIT_PREV)
+            compute_wait_load++;
+        if (compute == PROC_WAIT_NEXT)
+            compute_wait_store++;
+        if (store == PROC_BUSY)
+            store_busy++;
+
+        perf_cycles[PERF_LOAD_BUSY].write(load_busy);
+        perf_cycles[PERF_LOAD_WAIT_COMPUTE].write(load_wait_compute);
+        perf_cycles[PERF_COMPUTE_BUSY].write(compute_busy);
+        perf_cycles[PERF_COMPUTE_WAIT_LOAD].write(compute_wait_load);
+        perf_cycles[PERF_COMPUTE_WAIT_STORE].write(compute_wait_store);
+        perf_cycles[PERF_STORE_BUSY].write(store_busy);
+    }
+}
+
+
+
 void gemm_accelerator::store_output()
 {
     // Reset
@@ -131,6 +440,8 @@ void gemm_accelerator::store_output()
         HLS_PROTO("store-reset");
 
         this->reset_store_output();
+        this->store_jobs.reset_get();
+        this->store_state.write(PROC_IDLE);
 
         // explicit PLM ports reset if any
 
@@ -144,65 +455,253 @@ void gemm_accelerator::store_output()
     int32_t gemm_m;
     int32_t gemm_n;
     int32_t gemm_k;
+    int32_t transpose_b;
+    int32_t precision;
+    int32_t bias;
+    int32_t activation;
+    int32_t clamp_min;
+    int32_t clamp_max;
+    int32_t rq_scale;
+    int32_t rq_shift;
+    int32_t alpha;
+    int32_t beta;
+    int32_t batch_count;
+    int32_t stride_a;
+    int32_t stride_b;
+    int32_t stride_c;
+    int32_t lda;
+    int32_t ldb;
+    int32_t ldc;
+    int32_t a_offset;
+    int32_t b_offset;
+    int32_t c_offset;
+    int32_t sparse_b;
+    int32_t sparse_24;
+    int32_t perf;
+    int32_t chain;
+    int32_t gemm_p;
+    int32_t b2_offset;
+    int32_t jobs;
+    int32_t desc_offset;
+    int32_t notify;
+    conf_info_t config;
     {
         HLS_PROTO("store-config");
 
         cfg.wait_for_config(); // config process
-        conf_info_t config = this->conf_info.read();
+        config = this->conf_info.read();
 
-        // User-defined config code
-        /* <<--local-params-->> */
-        gemm_m = config.gemm_m;
-        gemm_n = config.gemm_n;
-        gemm_k = config.gemm_k;
+        jobs = config.jobs;
+        desc_offset = config.desc_offset;
+        notify = config.notify;
     }
 
-    // Store
+    // Kept across the jobs, like in load_input
+    bool ping = true;
+    uint32_t bias_slot = 0;
+    uint32_t write_beats = 0;
+
+    for (uint32_t job = 0; job < (jobs ? jobs : 1); job++)
     {
-        HLS_PROTO("store-dma");
-        wait();
+        {
+            HLS_PROTO("store-job");
+
+            // the descriptor fetched by load_input
+            if (jobs)
+                config = store_jobs.get();
+
+            // User-defined config code
+            /* <<--local-params-->> */
+            gemm_m = config.gemm_m;
+            gemm_n = config.gemm_n;
+            gemm_k = config.gemm_k;
+            transpose_b = config.transpose_b;
+            precision = config.precision;
+            bias = config.bias;
+            activation = config.activation;
+            clamp_min = config.clamp_min;
+            clamp_max = config.clamp_max;
+            rq_scale = config.rq_scale;
+            rq_shift = config.rq_shift;
+            alpha = config.alpha;
+            beta = config.beta;
+            batch_count = config.batch_count;
+            stride_a = config.stride_a;
+            stride_b = config.stride_b;
+            stride_c = config.stride_c;
+            lda = config.lda;
+            ldb = config.ldb;
+            ldc = config.ldc;
+            a_offset = config.a_offset;
+            b_offset = config.b_offset;
+            c_offset = config.c_offset;
+            sparse_b = config.sparse_b;
+            sparse_24 = config.sparse_24;
+            perf = config.perf;
+            chain = config.chain;
+            gemm_p = config.gemm_p;
+            b2_offset = config.b2_offset;
+        }
 
-        bool ping = true;
+#if !defined(GEMM_CHAIN)
+        // no fused chain in this configuration (see load_input)
+        chain = 0;
+#endif
 
-        // Moving in M dimension to new row of output
-        for (uint32_t num_m = 0; num_m < gemm_m/BLOCK_SIZE; num_m++)
+        if (chain)
         {
+            precision = PRECISION_INT32;
+            beta = 0;
+            batch_count = 1;
+            sparse_b = 0;
+            sparse_24 = 0;
+            // a whole row of blocks of A x B is kept in plm_mid
+            if (gemm_n > BLOCK_SIZE)
+                gemm_n = BLOCK_SIZE;
+        }
+
+        // With chain the output is D, gemm_m x gemm_p
+        if (chain)
+            gemm_n = gemm_p;
+
+        // Row pitch of C in words, 0 for packed rows (see load_input)
+        if (ldc == 0)
+            ldc = gemm_n;
+
+        // Store
+        {
+            HLS_PROTO("store-dma");
+            store_state.write(PROC_BUSY);
             wait();
-            // Moving in N dimension to new column of output
-            for (uint32_t num_n = 0; num_n < gemm_n/BLOCK_SIZE; num_n++)
-            {
-                this->store_compute_handshake();
 
-                uint32_t offset = (gemm_m * gemm_k) + (gemm_n * gemm_k) + (num_m * BLOCK_SIZE * gemm_n) + (num_n * BLOCK_SIZE);
+            uint32_t N_BLOCK_M = (gemm_m + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            uint32_t N_BLOCK_N = (gemm_n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+            // Output blocks come out in the same order they are computed in (see load_input);
+            // with chain, a row of blocks of D per block row of A
+            bool b_stationary = !chain && N_BLOCK_N < N_BLOCK_M;
+            uint32_t N_BLOCK_OUTER = b_stationary ? N_BLOCK_N : N_BLOCK_M;
+            uint32_t N_BLOCK_INNER = b_stationary ? N_BLOCK_M : N_BLOCK_N;
 
-                // each new row of the block
-                for (uint32_t row_num = 0; row_num < BLOCK_SIZE; row_num++)
+            // the output of batch i is stride_c words after the one of batch i - 1
+            for (uint32_t batch = 0; batch < batch_count; batch++)
+            {
+                // Moving to new row (or column) of output
+                for (uint32_t num_outer = 0; num_outer < N_BLOCK_OUTER; num_outer++)
                 {
                     wait();
+                    // Moving to new column (or row) of output
+                    for (uint32_t num_inner = 0; num_inner < N_BLOCK_INNER; num_inner++)
+                    {
+                        uint32_t num_m = b_stationary ? num_inner : num_outer;
+                        uint32_t num_n = b_stationary ? num_outer : num_inner;
 
-                    dma_info_t dma_info(offset / DMA_WORD_PER_BEAT, BLOCK_SIZE / DMA_WORD_PER_BEAT, DMA_SIZE);
-                    offset += gemm_n;
+                        uint32_t rows = block_extent(gemm_m, num_m);
+                        uint32_t cols = block_extent(gemm_n, num_n);
 
-                    this->dma_write_ctrl.put(dma_info);
+                        store_compute_sync();
 
-                    for (uint32_t i = 0; i < BLOCK_SIZE ; i += DMA_WORD_PER_BEAT)
-                    {
-                        sc_dt::sc_bv<DMA_WIDTH> dataBv;
+                        uint32_t offset = c_offset + (batch * stride_c) + (num_m * BLOCK_SIZE * ldc) + (num_n * BLOCK_SIZE);
 
-                        // Read from PLM
-                        wait();
-                        for (uint32_t k = 0; k < DMA_WORD_PER_BEAT; k++)
+                        // Rows as long as their pitch abut in memory: the block then goes
+                        // out in a single burst (see load_block)
+                        bool contiguous = (cols == ldc) && (cols % DMA_WORD_PER_BEAT == 0);
+                        uint32_t burst_rows = contiguous ? rows : 1;
+
+                        // each new row of the block, masking rows and columns past the
+                        // edge of the output
+                        for (uint32_t row_num = 0; row_num < rows; row_num++)
                         {
-                            HLS_UNROLL_SIMPLE;
-                            if (ping)
-                                dataBv.range((k+1) * DATA_WIDTH - 1, k * DATA_WIDTH) = plm_out_ping[(row_num * BLOCK_SIZE) + i + k];
-                            else
-                                dataBv.range((k+1) * DATA_WIDTH - 1, k * DATA_WIDTH) = plm_out_pong[(row_num * BLOCK_SIZE) + i + k];
+                            wait();
+
+                            if (!contiguous || row_num == 0)
+                            {
+                                dma_info_t dma_info(offset / DMA_WORD_PER_BEAT,
+                                                    burst_rows * ((cols + DMA_WORD_PER_BEAT - 1) / DMA_WORD_PER_BEAT), DMA_SIZE);
+
+                                this->dma_write_ctrl.put(dma_info);
+                                write_beats += dma_info.length;
+                            }
+                            offset += ldc;
+
+                            for (uint32_t i = 0; i < cols; i += DMA_WORD_PER_BEAT)
+                            {
+                                sc_dt::sc_bv<DMA_WIDTH> dataBv;
+
+                                // Read from PLM and apply the epilogue
+                                wait();
+                                for (uint32_t k = 0; k < DMA_WORD_PER_BEAT; k++)
+                                {
+                                    HLS_UNROLL_SIMPLE;
+                                    uint32_t acc;
+                                    if (ping)
+                                        acc = plm_out_ping[(row_num * BLOCK_SIZE) + i + k];
+                                    else
+                                        acc = plm_out_pong[(row_num * BLOCK_SIZE) + i + k];
+                                    uint32_t bias_word = plm_bias[(bias_slot * BLOCK_SIZE) + i + k];
+
+                                    dataBv.range((k+1) * DATA_WIDTH - 1, k * DATA_WIDTH) =
+                                        epilogue(acc, bias_word, bias, activation, clamp_min, clamp_max, rq_scale, rq_shift);
+                                }
+                                this->dma_write_chnl.put(dataBv);
+                            }
                         }
-                        this->dma_write_chnl.put(dataBv);
+                        ping = !ping;
+                        bias_slot = (bias_slot == BIAS_SLOTS - 1) ? 0 : bias_slot + 1;
                     }
                 }
-                ping = !ping;
+            }
+            store_state.write(PROC_IDLE);
+
+            // The performance counters follow the output, beat aligned
+            if (perf)
+            {
+                uint32_t offset_perf = round_up(c_offset + ((batch_count - 1) * stride_c) + (gemm_m * ldc),
+                                                DMA_WORD_PER_BEAT);
+
+                wait();
+                dma_info_t dma_info(offset_perf / DMA_WORD_PER_BEAT, PERF_WORDS / DMA_WORD_PER_BEAT, DMA_SIZE);
+                this->dma_write_ctrl.put(dma_info);
+
+                for (uint32_t i = 0; i < PERF_WORDS; i += DMA_WORD_PER_BEAT)
+                {
+                    sc_dt::sc_bv<DMA_WIDTH> dataBv;
+
+                    wait();
+                    for (uint32_t k = 0; k < DMA_WORD_PER_BEAT; k++)
+                    {
+                        HLS_UNROLL_SIMPLE;
+                        uint32_t counter;
+                        if (i + k < PERF_CYCLE_WORDS)
+                            counter = perf_cycles[i + k].read();
+                        else if (i + k == PERF_READ_BEATS)
+                            counter = read_beats.read();
+                        else
+                            counter = write_beats;
+
+                        dataBv.range((k+1) * DATA_WIDTH - 1, k * DATA_WIDTH) = counter;
+                    }
+                    this->dma_write_chnl.put(dataBv);
+                }
+            }
+
+            // The status word of the job in its descriptor, once its output is
+            // written (of the last job only, without notify)
+            if (jobs && (notify || job == jobs - 1))
+            {
+                sc_dt::sc_bv<DMA_WIDTH> dataBv;
+
+                wait();
+                dma_info_t dma_info((desc_offset + (job * DESC_WORDS) + DESC_STATUS) / DMA_WORD_PER_BEAT, 1, DMA_SIZE);
+                this->dma_write_ctrl.put(dma_info);
+                write_beats++;
+
+                for (uint32_t k = 0; k < DMA_WORD_PER_BEAT; k++)
+                {
+                    HLS_UNROLL_SIMPLE;
+                    dataBv.range((k+1) * DATA_WIDTH - 1, k * DATA_WIDTH) = (k == 0) ? job + 1 : 0;
+                }
+                this->dma_write_chnl.put(dataBv);
             }
         }
     }
@@ -222,6 +721,8 @@ void gemm_accelerator::compute_kernel()
         HLS_PROTO("compute-reset");
 
         this->reset_compute_kernel();
+        this->compute_jobs.reset_get();
+        this->compute_state.write(PROC_IDLE);
 
         // explicit PLM ports reset if any
 
@@ -235,188 +736,458 @@ void gemm_accelerator::compute_kernel()
     int32_t gemm_m;
     int32_t gemm_n;
     int32_t gemm_k;
+    int32_t transpose_b;
+    int32_t precision;
+    int32_t bias;
+    int32_t activation;
+    int32_t clamp_min;
+    int32_t clamp_max;
+    int32_t rq_scale;
+    int32_t rq_shift;
+    int32_t alpha;
+    int32_t beta;
+    int32_t batch_count;
+    int32_t stride_a;
+    int32_t stride_b;
+    int32_t stride_c;
+    int32_t lda;
+    int32_t ldb;
+    int32_t ldc;
+    int32_t a_offset;
+    int32_t b_offset;
+    int32_t c_offset;
+    int32_t sparse_b;
+    int32_t sparse_24;
+    int32_t perf;
+    int32_t chain;
+    int32_t gemm_p;
+    int32_t b2_offset;
+    int32_t jobs;
+    int32_t desc_offset;
+    int32_t notify;
+    conf_info_t config;
     {
         HLS_PROTO("compute-config");
 
         cfg.wait_for_config(); // config process
-        conf_info_t config = this->conf_info.read();
+        config = this->conf_info.read();
 
-        // User-defined config code
-        /* <<--local-params-->> */
-        gemm_m = config.gemm_m;
-        gemm_n = config.gemm_n;
-        gemm_k = config.gemm_k;
+        jobs = config.jobs;
+        desc_offset = config.desc_offset;
+        notify = config.notify;
     }
 
-    // Compute
+    // Kept across the jobs, like in load_input
     bool ping = true;
     bool ping_out = true;
-    uint32_t N_BLOCK_M = gemm_m/BLOCK_SIZE;
-    uint32_t N_BLOCK_N = gemm_n/BLOCK_SIZE;
-    uint32_t N_BLOCK_K = gemm_k/BLOCK_SIZE;
+    uint32_t num_panel = 0;
+
+    for (uint32_t job = 0; job < (jobs ? jobs : 1); job++)
     {
-        // Moving in M dimension for matrix 1, and moving to new row of output
-        for (uint32_t num_m = 0; num_m < N_BLOCK_M; num_m++)
         {
-            // Moving in N dimension for matrix 2, and moving to new column of output
-            for (uint32_t num_n = 0; num_n < N_BLOCK_N; num_n++)
-            {
-                // Moving in K dimension for both matrices to fully compute output
-                for (uint32_t num_k = 0; num_k < N_BLOCK_K; num_k++)
-                {
-                    this->compute_load_handshake();
-
-                    uint32_t regs_m[PLM_PORTS];
-                    uint32_t regs_n[PLM_PORTS];
-                    uint32_t regs_mul[PLM_PORTS];
-                    uint32_t regs_acc[PLM_PORTS];
-                    uint32_t regs_acc_0[8];
-                    uint32_t regs_acc_1[4];
-                    uint32_t regs_acc_2[2];
-                    HLS_FLATTEN_ARRAY(regs_m);
-                    HLS_FLATTEN_ARRAY(regs_n);
-                    HLS_FLATTEN_ARRAY(regs_mul);
-                    HLS_FLATTEN_ARRAY(regs_acc);
-                    HLS_FLATTEN_ARRAY(regs_acc_0);
-                    HLS_FLATTEN_ARRAY(regs_acc_1);
-                    HLS_FLATTEN_ARRAY(regs_acc_2);
-
-                    // Computing phase implementation
-                    for (uint32_t m_block = 0; m_block < N_SUB_BLOCK; m_block++)
-                    {
-                        for (uint32_t n_block = 0; n_block < N_SUB_BLOCK; n_block++)
-                        {
-                            for (uint32_t k_block = 0; k_block < N_SUB_BLOCK; k_block++)
-                            {
-                                for (uint32_t m = 0; m < PLM_PORTS; m++)
-                                {
-                                    uint32_t out_offset = m_block*BLOCK_SIZE*PLM_PORTS + n_block*PLM_PORTS + m*BLOCK_SIZE;
-
-                                    // read the previous partial sum, or not
-                                    if (num_k == 0 && k_block == 0)
-                                    {
-                                        for (int elem_n_0 = 0; elem_n_0 < PLM_PORTS; elem_n_0++)
-                                        {
-                                            HLS_UNROLL_LOOP(ON, "read_plm_out_0");
-
-                                            regs_acc[elem_n_0] = 0;
-                                        }
-                                    }
-                                    else
-                                    {
-                                        for (int elem_n_1 = 0; elem_n_1 < PLM_PORTS; elem_n_1++)
-                                        {
-                                            HLS_UNROLL_LOOP(ON, "read_plm_out_1");
-                                            HLS_BREAK_ARRAY_DEPENDENCY(plm_out_ping);
-                                            HLS_BREAK_ARRAY_DEPENDENCY(plm_out_pong);
-
-                                            uint32_t out_index = out_offset + elem_n_1;
-
-                                            if (ping_out)
-                                                regs_acc[elem_n_1] = plm_out_ping[out_index];
-                                            else
-                                                regs_acc[elem_n_1] = plm_out_pong[out_index];
-                                        }
-                                    }
-
-                                    uint32_t m_offset = m_block*BLOCK_SIZE*PLM_PORTS + k_block*PLM_PORTS + m*BLOCK_SIZE;
+            HLS_PROTO("compute-job");
+
+            // the descriptor fetched by load_input
+            if (jobs)
+                config = compute_jobs.get();
+
+            // User-defined config code
+            /* <<--local-params-->> */
+            gemm_m = config.gemm_m;
+            gemm_n = config.gemm_n;
+            gemm_k = config.gemm_k;
+            transpose_b = config.transpose_b;
+            precision = config.precision;
+            bias = config.bias;
+            activation = config.activation;
+            clamp_min = config.clamp_min;
+            clamp_max = config.clamp_max;
+            rq_scale = config.rq_scale;
+            rq_shift = config.rq_shift;
+            alpha = config.alpha;
+            beta = config.beta;
+            batch_count = config.batch_count;
+            stride_a = config.stride_a;
+            stride_b = config.stride_b;
+            stride_c = config.stride_c;
+            lda = config.lda;
+            ldb = config.ldb;
+            ldc = config.ldc;
+            a_offset = config.a_offset;
+            b_offset = config.b_offset;
+            c_offset = config.c_offset;
+            sparse_b = config.sparse_b;
+            sparse_24 = config.sparse_24;
+            perf = config.perf;
+            chain = config.chain;
+            gemm_p = config.gemm_p;
+            b2_offset = config.b2_offset;
+        }
 
-                                    // read the entire row for matrix 1 from PLM into an array
-                                    for (int elem_m = 0; elem_m < PLM_PORTS; elem_m++)
-                                    {
-                                        HLS_UNROLL_LOOP(ON, "read_plm_m");
-                                        HLS_BREAK_ARRAY_DEPENDENCY(plm_in_ping);
-                                        HLS_BREAK_ARRAY_DEPENDENCY(plm_in_pong);
+#if !defined(GEMM_CHAIN)
+        // no fused chain in this configuration (see load_input)
+        chain = 0;
+#endif
 
-                                        uint32_t m_index = m_offset + elem_m;
+        if (chain)
+        {
+            precision = PRECISION_INT32;
+            beta = 0;
+            batch_count = 1;
+            sparse_b = 0;
+            sparse_24 = 0;
+            // a whole row of blocks of A x B is kept in plm_mid
+            if (gemm_n > BLOCK_SIZE)
+                gemm_n = BLOCK_SIZE;
+        }
 
-                                        if (ping)
-                                            regs_m[elem_m] = plm_in_ping[m_index];
-                                        else
-                                            regs_m[elem_m] = plm_in_pong[m_index];
-                                    }
+        // K is counted in PLM words, each packing 1, 2 or 4 elements
+        int32_t log2_lanes = datapath_t::log2_lanes(precision);
+        int32_t gemm_kw = (gemm_k + (1 << log2_lanes) - 1) >> log2_lanes;
+
+#if !defined(SPARSE_24)
+        // no 2:4 datapath in this configuration (see load_input)
+        sparse_24 = 0;
+#endif
+
+        // Compute
+        uint32_t N_BLOCK_M = (gemm_m + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        uint32_t N_BLOCK_N = (gemm_n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        uint32_t N_BLOCK_K = (gemm_kw + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        uint32_t N_BLOCK_P = (gemm_p + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+        // Same loop schedule as load_input: the stationary operand is in plm_panel
+        bool b_stationary = !chain && N_BLOCK_N < N_BLOCK_M;
+        uint32_t N_BLOCK_OUTER = b_stationary ? N_BLOCK_N : N_BLOCK_M;
+        uint32_t N_BLOCK_INNER = b_stationary ? N_BLOCK_M : N_BLOCK_N;
+        {
+            compute_state.write(PROC_BUSY);
 
-                                    for (uint32_t n = 0; n < PLM_PORTS; n++)
-                                    {
-                                        HLS_PIPELINE_LOOP(HARD_STALL, 1, "pipe_mac");
+            // let load_input on to the next job (see load_input)
+            if (job > 0)
+                compute_load_sync();
 
-                                        uint32_t n_offset = (PLM_IN_WORD/2) + n_block*BLOCK_SIZE*PLM_PORTS + k_block*PLM_PORTS + n*BLOCK_SIZE;
+            // wait for the tile bitmap of B (see load_input)
+            if (sparse_b)
+                compute_load_sync();
 
-                                        // read the entire row for matrix 2 from PLM into an array
-                                        for (int elem_n = 0; elem_n < PLM_PORTS; elem_n++)
-                                        {
-                                            HLS_UNROLL_LOOP(ON, "read_plm_n");
-                                            HLS_BREAK_ARRAY_DEPENDENCY(plm_in_ping);
-                                            HLS_BREAK_ARRAY_DEPENDENCY(plm_in_pong);
+            // Batches follow each other through the pipeline (see load_input)
+            for (uint32_t batch = 0; batch < batch_count; batch++)
+            {
+                // Moving along the stationary operand, and moving to new row (or column) of output
+                for (uint32_t num_outer = 0; num_outer < N_BLOCK_OUTER; num_outer++)
+                {
+                    // Moving along the streamed operand, and moving to new column (or row) of output
+                    for (uint32_t num_inner = 0; num_inner < N_BLOCK_INNER; num_inner++)
+                    {
+                        uint32_t num_m = b_stationary ? num_inner : num_outer;
+                        uint32_t num_n = b_stationary ? num_outer : num_inner;
 
-                                            uint32_t n_index = n_offset + elem_n;
+                        // Sub-blocks past the edge of a partial block are skipped
+                        uint32_t n_sub_m = (block_extent(gemm_m, num_m) + PLM_PORTS - 1) / PLM_PORTS;
+                        uint32_t n_sub_n = (block_extent(gemm_n, num_n) + PLM_PORTS - 1) / PLM_PORTS;
 
-                                            if (ping)
-                                                regs_n[elem_n] = plm_in_ping[n_index];
-                                            else
-                                                regs_n[elem_n] = plm_in_pong[n_index];
-                                        }
+                        // no tile contributed to the output block yet
+                        bool empty = true;
 
-                                        // multiply all elements stored in regs_m and regs_n
-                                        for (uint32_t mul = 0; mul < PLM_PORTS; mul++)
-                                        {
-                                            HLS_UNROLL_LOOP(ON, "multiply_k");
+                        // Moving in K dimension for both matrices to fully compute output
+                        bool stepped = false;
+                        for (uint32_t num_k = 0; num_k < N_BLOCK_K; num_k++)
+                        {
+                            // same steps as load_input; the MACs of a zero tile are skipped
+                            bool tile_nz = !sparse_b || tile_nonzero(BITMAP_COMPUTE, N_BLOCK_K, num_n, num_k);
+                            if (step_needed(tile_nz, bias && !stepped, b_stationary, N_BLOCK_K, N_BLOCK_INNER, num_inner, num_k))
+                            {
+                                stepped = true;
+                                compute_load_sync();
 
-                                            regs_mul[mul] = regs_m[mul] * regs_n[mul];
-                                        }
+                                uint32_t panel_base = panel_slot(N_BLOCK_K, num_panel, num_k, ping) * PLM_OUT_WORD;
+                                uint32_t n_sub_k = sparse_24 ? (block_extent(gemm_kw, num_k) + 2 * PLM_PORTS - 1) / (2 * PLM_PORTS)
+                                                             : (block_extent(gemm_kw, num_k) + PLM_PORTS - 1) / PLM_PORTS;
 
-                                        for (uint32_t mul = 0, acc = 0; mul < 16; mul=mul+2, acc++)
+                                if (tile_nz)
+                                {
+#if defined(COMPUTE_SYSTOLIC)
+                                    // Output-stationary array: the partial sums stay in the PEs for the
+                                    // whole K block
+                                    systolic_block(block_extent(gemm_m, num_m), block_extent(gemm_n, num_n),
+                                                   block_extent(gemm_kw, num_k), panel_base, b_stationary,
+                                                   ping, ping_out, empty, precision);
+#else
+                                    // The lanes split the sub-blocks of the streamed operand: each lane
+                                    // has its own copy of plm_in_ping/pong and its own row of accumulators,
+                                    // and the slice of the stationary operand is shared
+                                    uint32_t regs_panel[PLM_PORTS];
+                                    uint32_t regs_in[COMPUTE_LANES][PLM_PORTS];
+                                    uint32_t regs_acc[COMPUTE_LANES][PLM_PORTS];
+                                    uint32_t regs_tree[COMPUTE_LANES][PLM_PORTS];
+                                    HLS_FLATTEN_ARRAY(regs_panel);
+                                    HLS_FLATTEN_ARRAY(regs_in);
+                                    HLS_FLATTEN_ARRAY(regs_acc);
+                                    HLS_FLATTEN_ARRAY(regs_tree);
+
+                                    uint32_t m_step = b_stationary ? COMPUTE_LANES : 1;
+                                    uint32_t n_step = b_stationary ? 1 : COMPUTE_LANES;
+
+                                    // Computing phase implementation: each row of an output sub-block
+                                    // stays in regs_acc for the whole K block, so plm_out is read and
+                                    // written once per row rather than once per k_block
+                                    for (uint32_t m_block = 0; m_block < n_sub_m; m_block += m_step)
+                                    {
+                                        for (uint32_t n_block = 0; n_block < n_sub_n; n_block += n_step)
                                         {
-                                            HLS_UNROLL_LOOP(ON, "accumulate_k_0");
-
-                                            regs_acc_0[acc] = regs_mul[mul]  + regs_mul[mul+1];
+                                            for (uint32_t m = 0; m < PLM_PORTS; m++)
+                                            {
+                                                // read the previous partial sums, or not; the lanes share
+                                                // the plm_out ports, so they take turns
+                                                for (uint32_t lane = 0; lane < COMPUTE_LANES; lane++)
+                                                {
+                                                    uint32_t lane_m_block = m_block + (b_stationary ? lane : 0);
+                                                    uint32_t lane_n_block = n_block + (b_stationary ? 0 : lane);
+                                                    uint32_t out_offset = lane_m_block*BLOCK_SIZE*PLM_PORTS + lane_n_block*PLM_PORTS + m*BLOCK_SIZE;
+
+                                                    if (empty)
+                                                    {
+                                                        for (int elem_n_0 = 0; elem_n_0 < PLM_PORTS; elem_n_0++)
+                                                        {
+                                                            HLS_UNROLL_LOOP(ON, "read_plm_out_0");
+
+                                                            regs_acc[lane][elem_n_0] = 0;
+                                                        }
+                                                    }
+                                                    else
+                                                    {
+                                                        for (int elem_n_1 = 0; elem_n_1 < PLM_PORTS; elem_n_1++)
+                                                        {
+                                                            HLS_UNROLL_LOOP(ON, "read_plm_out_1");
+                                                            HLS_BREAK_ARRAY_DEPENDENCY(plm_out_ping);
+                                                            HLS_BREAK_ARRAY_DEPENDENCY(plm_out_pong);
+
+                                                            uint32_t out_index = out_offset + elem_n_1;
+
+                                                            if (ping_out)
+                                                                regs_acc[lane][elem_n_1] = plm_out_ping[out_index];
+                                                            else
+                                                                regs_acc[lane][elem_n_1] = plm_out_pong[out_index];
+                                                        }
+                                                    }
+                                                }
+
+                                                // (k_block, n) flattened into one pipeline, so it does not
+                                                // drain at every k_block
+                                                for (uint32_t kn = 0; kn < n_sub_k * PLM_PORTS; kn++)
+                                                {
+                                                    HLS_PIPELINE_LOOP(HARD_STALL, 1, "pipe_mac");
+
+                                                    uint32_t k_block = kn / PLM_PORTS;
+                                                    uint32_t n = kn % PLM_PORTS;
+
+                                                    // row of the stationary operand (shared), and of the
+                                                    // streamed operand for lane 0; the slice of a 2:4 sparse
+                                                    // B spans twice as many words of A
+                                                    uint32_t k_a = sparse_24 ? k_block*2*PLM_PORTS : k_block*PLM_PORTS;
+                                                    uint32_t k_b = k_block*PLM_PORTS;
+                                                    uint32_t panel_offset = (b_stationary ? n_block*BLOCK_SIZE*PLM_PORTS + n*BLOCK_SIZE
+                                                                                          : m_block*BLOCK_SIZE*PLM_PORTS + m*BLOCK_SIZE)
+                                                                            + (b_stationary ? k_b : k_a);
+                                                    uint32_t in_offset = (b_stationary ? m_block*BLOCK_SIZE*PLM_PORTS + m*BLOCK_SIZE
+                                                                                       : n_block*BLOCK_SIZE*PLM_PORTS + n*BLOCK_SIZE)
+                                                                         + (b_stationary ? k_a : k_b);
+
+                                                    // read the row slices of both matrices from PLM into arrays
+                                                    for (int elem = 0; elem < PLM_PORTS; elem++)
+                                                    {
+                                                        HLS_UNROLL_LOOP(ON, "read_plm_panel");
+                                                        HLS_BREAK_ARRAY_DEPENDENCY(plm_panel);
+
+                                                        regs_panel[elem] = plm_panel[panel_base + panel_offset + elem];
+                                                    }
+
+                                                    for (uint32_t lane = 0; lane < COMPUTE_LANES; lane++)
+                                                    {
+                                                        HLS_UNROLL_LOOP(ON, "read_plm_in_lanes");
+
+                                                        // the next lane is one sub-block further along the streamed operand
+                                                        uint32_t in_index = in_offset + lane*BLOCK_SIZE*PLM_PORTS;
+
+                                                        for (int elem = 0; elem < PLM_PORTS; elem++)
+                                                        {
+                                                            HLS_UNROLL_LOOP(ON, "read_plm_in");
+                                                            HLS_BREAK_ARRAY_DEPENDENCY(plm_in_ping);
+                                                            HLS_BREAK_ARRAY_DEPENDENCY(plm_in_pong);
+
+                                                            if (ping)
+                                                                regs_in[lane][elem] = plm_in_ping[lane][in_index + elem];
+                                                            else
+                                                                regs_in[lane][elem] = plm_in_pong[lane][in_index + elem];
+                                                        }
+                                                    }
+
+#if defined(SPARSE_24)
+                                                    // 2:4 sparse B: each value picks its A word out of its group
+                                                    // of 4, in a window of 2 * PLM_PORTS words of A
+                                                    if (sparse_24)
+                                                    {
+                                                        uint32_t regs_window[2 * PLM_PORTS];
+                                                        HLS_FLATTEN_ARRAY(regs_window);
+
+                                                        for (int elem = 0; elem < PLM_PORTS; elem++)
+                                                        {
+                                                            HLS_UNROLL_LOOP(ON, "read_window_24");
+                                                            HLS_BREAK_ARRAY_DEPENDENCY(plm_panel);
+                                                            HLS_BREAK_ARRAY_DEPENDENCY(plm_in_ping);
+                                                            HLS_BREAK_ARRAY_DEPENDENCY(plm_in_pong);
+
+                                                            regs_window[elem] = b_stationary ? regs_in[0][elem] : regs_panel[elem];
+                                                            if (!b_stationary)
+                                                                regs_window[PLM_PORTS + elem] = plm_panel[panel_base + panel_offset + PLM_PORTS + elem];
+                                                            else if (ping)
+                                                                regs_window[PLM_PORTS + elem] = plm_in_ping[0][in_offset + PLM_PORTS + elem];
+                                                            else
+                                                                regs_window[PLM_PORTS + elem] = plm_in_pong[0][in_offset + PLM_PORTS + elem];
+                                                        }
+
+                                                        // 2 bits per value, after the BLOCK_SIZE / 2 values of the B row
+                                                        uint32_t index_offset = (b_stationary ? panel_base + panel_offset : in_offset)
+                                                                                - k_b + (BLOCK_SIZE / 2) + (k_b / 16);
+                                                        uint32_t indices;
+                                                        if (b_stationary)
+                                                            indices = plm_panel[index_offset];
+                                                        else if (ping)
+                                                            indices = plm_in_ping[0][index_offset];
+                                                        else
+                                                            indices = plm_in_pong[0][index_offset];
+                                                        indices >>= (2 * k_b) % 32;
+
+                                                        for (int elem = 0; elem < PLM_PORTS; elem++)
+                                                        {
+                                                            HLS_UNROLL_LOOP(ON, "select_24");
+
+                                                            uint32_t word_a = regs_window[(elem / 2) * 4 + ((indices >> (2 * elem)) & 3)];
+
+                                                            if (b_stationary)
+                                                                regs_in[0][elem] = word_a;
+                                                            else
+                                                                regs_panel[elem] = word_a;
+                                                        }
+                                                    }
+#endif
+
+                                                    for (uint32_t lane = 0; lane < COMPUTE_LANES; lane++)
+                                                    {
+                                                        HLS_UNROLL_LOOP(ON, "mac_lanes");
+
+                                                        // multiply all elements stored in regs_panel and regs_in; packed
+                                                        // words are split into sub-word lanes whose products are summed
+                                                        for (uint32_t mul = 0; mul < PLM_PORTS; mul++)
+                                                        {
+                                                            HLS_UNROLL_LOOP(ON, "multiply_k");
+
+                                                            regs_tree[lane][mul] = datapath_t::mul(regs_panel[mul], regs_in[lane][mul], precision);
+                                                        }
+
+                                                        // log2(PLM_PORTS) levels of pairwise adders
+                                                        for (uint32_t len = PLM_PORTS / 2; len > 0; len /= 2)
+                                                        {
+                                                            HLS_UNROLL_LOOP(ON, "accumulate_k");
+
+                                                            for (uint32_t acc = 0; acc < len; acc++)
+                                                            {
+                                                                HLS_UNROLL_LOOP(ON, "accumulate_k_level");
+
+                                                                regs_tree[lane][acc] = datapath_t::add(regs_tree[lane][2 * acc], regs_tree[lane][2 * acc + 1]);
+                                                            }
+                                                        }
+
+                                                        regs_acc[lane][n] = datapath_t::add(regs_acc[lane][n], regs_tree[lane][0]);
+                                                    }
+                                                }
+
+                                                // assign the accumulate to the plm_out; lanes past the edge
+                                                // of a partial block computed on stale data and are dropped
+                                                for (uint32_t lane = 0; lane < COMPUTE_LANES; lane++)
+                                                {
+                                                    uint32_t lane_m_block = m_block + (b_stationary ? lane : 0);
+                                                    uint32_t lane_n_block = n_block + (b_stationary ? 0 : lane);
+                                                    uint32_t out_offset = lane_m_block*BLOCK_SIZE*PLM_PORTS + lane_n_block*PLM_PORTS + m*BLOCK_SIZE;
+
+                                                    if (lane_m_block < n_sub_m && lane_n_block < n_sub_n)
+                                                    {
+                                                        for (int elem_n = 0; elem_n < PLM_PORTS; elem_n++)
+                                                        {
+                                                            HLS_UNROLL_LOOP(ON, "write_plm_out");
+                                                            HLS_BREAK_ARRAY_DEPENDENCY(plm_out_ping);
+                                                            HLS_BREAK_ARRAY_DEPENDENCY(plm_out_pong);
+
+                                                            uint32_t out_index = out_offset + elem_n;
+
+                                                            if (ping_out)
+                                                                plm_out_ping[out_index] = regs_acc[lane][elem_n];
+                                                            else
+                                                                plm_out_pong[out_index] = regs_acc[lane][elem_n];
+                                                        }
+                                                    }
+                                                }
+                                            }
                                         }
+                                    }
+#endif
+                                    empty = false;
+                                }
+                                ping = !ping;
+                            }
+                        }
 
-                                        for (uint32_t mul = 0, acc = 0; mul < 8; mul=mul+2, acc++)
-                                        {
-                                            HLS_UNROLL_LOOP(ON, "accumulate_k_1");
+                        // alpha * A x B + beta * C. The C tile arrives after the last K
+                        // block, so that alpha scales the product only. An empty block
+                        // (all its tiles of B are zero) is written here
+                        if (beta != 0 || (uint32_t) alpha != datapath_t::ONE || empty)
+                        {
+                            if (beta != 0)
+                                compute_load_sync();
 
-                                            regs_acc_1[acc] = regs_acc_0[mul]  + regs_acc_0[mul+1];
-                                        }
+                            scale_output(block_extent(gemm_m, num_m), block_extent(gemm_n, num_n),
+                                         alpha, beta, beta != 0, empty, ping, ping_out);
 
-                                        for (uint32_t mul = 0, acc = 0; mul < 4; mul=mul+2, acc++)
-                                        {
-                                            HLS_UNROLL_LOOP(ON, "accumulate_k_2");
+                            if (beta != 0)
+                                ping = !ping;
+                        }
 
-                                            regs_acc_2[acc] = regs_acc_1[mul]  + regs_acc_1[mul+1];
-                                        }
+#if defined(GEMM_CHAIN)
+                        // The intermediate block is multiplied by each block of B2 in
+                        // turn, making a row of blocks of D (see load_input)
+                        if (chain)
+                        {
+                            uint32_t rows = block_extent(gemm_m, num_m);
 
-                                        regs_acc[n] += regs_acc_2[0] + regs_acc_2[1];
-                                    }
+                            chain_intermediate(rows, block_extent(gemm_n, num_n), activation, clamp_min, clamp_max, ping_out);
 
-                                    // assign the accumulate to the plm_out
-                                    for (int elem_n = 0; elem_n < PLM_PORTS; elem_n++)
-                                    {
-                                        HLS_UNROLL_LOOP(ON, "write_plm_out");
-                                        HLS_BREAK_ARRAY_DEPENDENCY(plm_out_ping);
-                                        HLS_BREAK_ARRAY_DEPENDENCY(plm_out_pong);
+                            for (uint32_t num_p = 0; num_p < N_BLOCK_P; num_p++)
+                            {
+                                compute_load_sync();
 
-                                        uint32_t out_index = out_offset + elem_n;
+                                chain_block(rows, block_extent(gemm_p, num_p), gemm_n, ping, ping_out);
 
-                                        if (ping_out)
-                                            plm_out_ping[out_index] = regs_acc[elem_n];
-                                        else
-                                            plm_out_pong[out_index] = regs_acc[elem_n];
-                                    }
-                                }
+                                compute_store_sync();
+                                ping_out = !ping_out;
+                                ping = !ping;
                             }
+                            continue;
                         }
+#endif
+
+                        compute_store_sync();
+                        ping_out = !ping_out;
                     }
-                    ping = !ping;
+                    num_panel++;
                 }
-                this->compute_store_handshake();
-                ping_out = !ping_out;
             }
+            compute_state.write(PROC_IDLE);
         }
+    }
 
-        // Conclude
-        {
-            this->process_done();
-        }
+    // Conclude
+    {
+        this->process_done();
     }
 }
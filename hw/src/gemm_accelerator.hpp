@@ -9,6 +9,8 @@
 
 #include "esp_templates.hpp"
 
+#include "cynw_fifo.h"
+
 #include "gemm_accelerator_directives.hpp"
 
 #define __round_mask(x, y) ((y)-1)
@@ -16,11 +18,170 @@
 /* <<--defines-->> */
 #define DATA_WIDTH 32
 #define DMA_SIZE SIZE_WORD
+
+// Design-space parameters, overridden per HLS configuration (project.tcl):
+// the block edge, the PLM ports (and MAC lanes) of the compute kernel, and
+// the number of blocks in the stationary panel
+#ifndef BLOCK_SIZE
 #define BLOCK_SIZE 64
+#endif
+#ifndef PLM_PORTS
 #define PLM_PORTS 16
+#endif
+#ifndef PANEL_BLOCKS
+#define PANEL_BLOCKS 4
+#endif
+
+#if (PLM_PORTS < 2) || (PLM_PORTS & (PLM_PORTS - 1))
+#error PLM_PORTS must be a power of two
+#endif
+#if (BLOCK_SIZE % PLM_PORTS)
+#error BLOCK_SIZE must be a multiple of PLM_PORTS
+#endif
+// the store phase reads a DMA beat of plm_out per cycle, one word per bank
+#if (DMA_WORD_PER_BEAT > PLM_PORTS)
+#error DMA_WIDTH / 32 must not exceed PLM_PORTS
+#endif
+
+// Parallel MAC pipelines of the basic engine. The lanes split the sub-blocks
+// of the streamed operand, each reading its own copy of plm_in_ping/pong,
+// while the stationary slice from the panel is shared
+#ifndef COMPUTE_LANES
+#define COMPUTE_LANES 1
+#endif
+
+#if (BLOCK_SIZE / PLM_PORTS) % COMPUTE_LANES
+#error COMPUTE_LANES must divide BLOCK_SIZE / PLM_PORTS
+#endif
+#if defined(COMPUTE_SYSTOLIC) && (COMPUTE_LANES != 1)
+#error COMPUTE_LANES applies to the basic engine only
+#endif
+
+// Edge of the systolic array (COMPUTE_SYSTOLIC): SA_DIM x SA_DIM PEs fed by
+// SA_DIM lanes per operand, at most one per PLM port
+#ifndef SA_DIM
+#define SA_DIM 8
+#endif
+
+#if defined(COMPUTE_SYSTOLIC) && ((SA_DIM > PLM_PORTS) || (BLOCK_SIZE % SA_DIM))
+#error SA_DIM must divide BLOCK_SIZE and not exceed PLM_PORTS
+#endif
+
+// 2:4 structured sparsity of B (runtime sparse_24) in the basic engine: each
+// PLM_PORTS-word slice of B holds the kept values of 2 * PLM_PORTS words of K,
+// and their 2-bit indices pick the A words they multiply. A block row of B is
+// stored compressed as BLOCK_SIZE / 2 values followed by their indices
+#if defined(SPARSE_24)
+#if defined(COMPUTE_SYSTOLIC) || (COMPUTE_LANES != 1)
+#error SPARSE_24 applies to the basic engine with one lane only
+#endif
+#if (PLM_PORTS > 16) || (BLOCK_SIZE % (2 * PLM_PORTS)) || (BLOCK_SIZE % 32)
+#error SPARSE_24 needs PLM_PORTS <= 16 and BLOCK_SIZE a multiple of 32 and of 2 * PLM_PORTS
+#endif
+#define K_PAD (2 * PLM_PORTS)
+#else
+#define K_PAD PLM_PORTS
+#endif
+#define SPARSE_24_WORDS ((BLOCK_SIZE / 2) + (BLOCK_SIZE / 32))
+
 #define N_SUB_BLOCK (BLOCK_SIZE / PLM_PORTS)
 #define PLM_OUT_WORD (BLOCK_SIZE * BLOCK_SIZE)
-#define PLM_IN_WORD (2 * PLM_OUT_WORD)
+#define PLM_IN_WORD PLM_OUT_WORD
+#define PLM_PANEL_WORD (PANEL_BLOCKS * PLM_OUT_WORD)
+
+// Bias slices of the output blocks being loaded, computed and stored
+#define BIAS_SLOTS 3
+#define PLM_BIAS_WORD (BIAS_SLOTS * BLOCK_SIZE)
+
+// Tile bitmap of B (sparse_b): one bit per BLOCK_SIZE x BLOCK_SIZE tile, so
+// 32 * PLM_BITMAP_WORD tiles at most. The load and compute processes each
+// read their own copy
+#ifndef PLM_BITMAP_WORD
+#define PLM_BITMAP_WORD 64
+#endif
+#define BITMAP_COPIES 2
+#define BITMAP_LOAD 0
+#define BITMAP_COMPUTE 1
+
+// DMA read requests queued ahead of the data (off by default): with
+// DMA_READ_AHEAD > 0, load_input queues the requests of the next rows of a
+// block while it drains the current one, and load_request hands them to the
+// DMA as it accepts them. The ESP DMA takes a request only once it has sent
+// the data of the previous one, so on ESP the requests do not overlap the data
+// and the queue brings no speedup; it is left for DMAs that pipeline requests
+#ifndef DMA_READ_AHEAD
+#define DMA_READ_AHEAD 0
+#endif
+// Bursts whose requests load_block issues ahead of the data being drained
+#if DMA_READ_AHEAD > 0
+#define READ_AHEAD_BURSTS DMA_READ_AHEAD
+#else
+#define READ_AHEAD_BURSTS 1
+#endif
+
+// Fused chain (runtime chain) built with GEMM_CHAIN: each output block of
+// A x B, with gemm_n <= BLOCK_SIZE, goes through the activation into plm_mid
+// instead of memory, and is multiplied there by the gemm_p x gemm_n matrix B2
+// into the output blocks of D = act(A x B) x B2
+#if defined(GEMM_CHAIN) && defined(DATAPATH_BF16)
+#error GEMM_CHAIN needs the integer or the fixed-point datapath
+#endif
+
+// Performance counters (runtime perf), written by store_output after the
+// output, beat aligned: cycles of each process busy or stalled on another
+// one, then the DMA beats read and written
+#define PERF_LOAD_BUSY 0
+#define PERF_LOAD_WAIT_COMPUTE 1
+#define PERF_COMPUTE_BUSY 2
+#define PERF_COMPUTE_WAIT_LOAD 3
+#define PERF_COMPUTE_WAIT_STORE 4
+#define PERF_STORE_BUSY 5
+#define PERF_READ_BEATS 6
+#define PERF_WRITE_BEATS 7
+#define PERF_CYCLE_WORDS 6
+#define PERF_WORDS 8
+
+// Descriptor ring (runtime jobs): job j is described by the DESC_WORDS words
+// at desc_offset + j * DESC_WORDS, the gemm_m to b2_offset fields of
+// conf_info_t in order, then the status word store_output writes when the job
+// is done (the number of jobs done so far)
+#define DESC_FIELDS 29
+#define DESC_STATUS 32
+#define DESC_WORDS 40
+#if (DESC_WORDS % DMA_WORD_PER_BEAT) || (DESC_STATUS % DMA_WORD_PER_BEAT)
+#error DESC_WORDS and DESC_STATUS must be multiples of DMA_WIDTH / 32
+#endif
+
+// Descriptors fetched by load_input ahead of compute_kernel and store_output,
+// which are still on previous jobs
+#ifndef DESC_QUEUE
+#define DESC_QUEUE 2
+#endif
+
+// State of a process, sampled every cycle by perf_counters: waiting in its
+// handshake with the previous (or next) process of the pipeline
+#define PROC_IDLE 0
+#define PROC_BUSY 1
+#define PROC_WAIT_PREV 2
+#define PROC_WAIT_NEXT 3
+
+// Epilogue activation (runtime)
+#define ACT_NONE 0
+#define ACT_RELU 1
+#define ACT_CLAMP 2
+
+// Element precision (runtime): PLM words hold 1, 2 or 4 packed elements
+#define PRECISION_INT32 0
+#define PRECISION_INT16 1
+#define PRECISION_INT8 2
+
+// Most elements per word the datapath supports (1, 2 or 4); lower values
+// drop the sub-word multipliers
+#ifndef PACK_MAX
+#define PACK_MAX 4
+#endif
+
+#include "gemm_accelerator_datapath.hpp"
 
 class gemm_accelerator : public esp_accelerator_3P<DMA_WIDTH>
 {
@@ -34,12 +195,35 @@ public:
         // Signal binding
         cfg.bind_with(*this);
 
+#if DMA_READ_AHEAD > 0
+        // Read requests of load_input, issued to the DMA by load_request
+        SC_CTHREAD(load_request, this->clk.pos());
+        this->reset_signal_is(this->rst, false);
+        read_queue.clk_rst(this->clk, this->rst);
+#endif
+        compute_jobs.clk_rst(this->clk, this->rst);
+        store_jobs.clk_rst(this->clk, this->rst);
+
+        // Cycle counters, sampling the state of the other processes
+        SC_CTHREAD(perf_counters, this->clk.pos());
+        this->reset_signal_is(this->rst, false);
+
         // Map arrays to memories
         /* <<--plm-bind-->> */
         HLS_MAP_plm(plm_out_pong, PLM_OUT_NAME);
         HLS_MAP_plm(plm_out_ping, PLM_OUT_NAME);
-        HLS_MAP_plm(plm_in_pong, PLM_IN_NAME);
-        HLS_MAP_plm(plm_in_ping, PLM_IN_NAME);
+        for (uint32_t lane = 0; lane < COMPUTE_LANES; lane++)
+        {
+            HLS_MAP_plm(plm_in_pong[lane], PLM_IN_NAME);
+            HLS_MAP_plm(plm_in_ping[lane], PLM_IN_NAME);
+        }
+        HLS_MAP_plm(plm_panel, PLM_PANEL_NAME);
+        HLS_MAP_plm(plm_bias, PLM_BIAS_NAME);
+        for (uint32_t copy = 0; copy < BITMAP_COPIES; copy++)
+            HLS_MAP_plm(plm_bitmap[copy], PLM_BITMAP_NAME);
+#if defined(GEMM_CHAIN)
+        HLS_MAP_plm(plm_mid, PLM_OUT_NAME);
+#endif
     }
 
     // Processes
@@ -47,22 +231,121 @@ public:
     // Load the input data
     void load_input();
 
+#if DMA_READ_AHEAD > 0
+    // Issue the queued read requests of load_input to the DMA
+    void load_request();
+#endif
+
     // Computation
     void compute_kernel();
 
+    // Count the busy and stalled cycles of load_input, compute_kernel and store_output
+    void perf_counters();
+
     // Store the output data
     void store_output();
 
     // Configure gemm_accelerator
     esp_config_proc cfg;
 
+#if DMA_READ_AHEAD > 0
+    // Read requests from load_input to load_request; load_input never queues
+    // more than DMA_READ_AHEAD, so it never waits on a full queue
+    cynw_fifo<dma_info_t, DMA_READ_AHEAD> read_queue;
+#endif
+
+    // The descriptors of the ring, from load_input to the other processes
+    cynw_fifo<conf_info_t, DESC_QUEUE> compute_jobs;
+    cynw_fifo<conf_info_t, DESC_QUEUE> store_jobs;
+
+    // Process states (PROC_*), the cycle counters of perf_counters and the
+    // beats requested by load_input, read by store_output at the end
+    sc_signal<sc_dt::sc_uint<2> > load_state;
+    sc_signal<sc_dt::sc_uint<2> > compute_state;
+    sc_signal<sc_dt::sc_uint<2> > store_state;
+    sc_signal<uint32_t> perf_cycles[PERF_CYCLE_WORDS];
+    sc_signal<uint32_t> read_beats;
+
     // Functions
 
+    // The handshakes between the processes, with the stall recorded in the
+    // state of the caller for perf_counters
+    inline void load_compute_sync();
+    inline void compute_load_sync();
+    inline void compute_store_sync();
+    inline void store_compute_sync();
+
+    // Request (or queue, with read-ahead) a read of words words at offset,
+    // from the enclosing DMA beat
+    inline void read_request(uint32_t offset, uint32_t words);
+
+    // Fetch a (partial) block of rows x cols words into the panel or the ping/pong PLM
+    inline void load_block(uint32_t offset, uint32_t row_stride, uint32_t rows, uint32_t cols,
+                           bool transposed, bool to_panel, uint32_t slot, bool ping);
+
+    // Write a word of a block being loaded to the panel, or to every lane's ping/pong copy
+    inline void write_in(uint32_t plm_index, int32_t word, bool to_panel, uint32_t panel_base, bool ping);
+
+    // Fetch the bias slice of an output block into a slot of plm_bias
+    inline void load_bias(uint32_t offset, uint32_t cols, uint32_t slot);
+
+    // Fetch the tile bitmap of B into both copies of plm_bitmap
+    inline void load_bitmap(uint32_t offset, uint32_t words);
+
+    // Fetch the descriptor at offset into the fields of desc
+    inline void load_desc(uint32_t offset, conf_info_t &desc);
+
+    // Whether tile (num_n, num_k) of B may hold non-zero elements
+    inline bool tile_nonzero(uint32_t copy, uint32_t n_block_k, uint32_t num_n, uint32_t num_k);
+
+    // Whether the K step runs (loads blocks and handshakes) with tile_nz given,
+    // keeping the last one of the output block if keep_last
+    inline bool step_needed(bool tile_nz, bool keep_last, bool b_stationary, uint32_t n_block_k,
+                            uint32_t n_block_inner, uint32_t num_inner, uint32_t num_k);
+
+    // Bias, activation and requantization of an output word on its way to memory
+    inline uint32_t epilogue(uint32_t acc, uint32_t bias_word, int32_t bias, int32_t activation,
+                             int32_t clamp_min, int32_t clamp_max, int32_t rq_scale, int32_t rq_shift);
+
+    // alpha * plm_out (0 if empty), plus beta times the C tile in the ping/pong PLM if load_c
+    inline void scale_output(uint32_t rows, uint32_t cols, uint32_t alpha, uint32_t beta,
+                             bool load_c, bool empty, bool ping, bool ping_out);
+
+    // Slot of the panel PLM holding the stationary block of the current step
+    inline uint32_t panel_slot(uint32_t n_block_k, uint32_t num_panel, uint32_t num_k, bool ping);
+
+    // Number of valid rows (or columns) of block num_block along a dimension
+    inline uint32_t block_extent(uint32_t dim, uint32_t num_block);
+
+#if defined(GEMM_CHAIN)
+    // Activation of the rows x cols output block of A x B into plm_mid
+    inline void chain_intermediate(uint32_t rows, uint32_t cols, int32_t activation,
+                                   int32_t clamp_min, int32_t clamp_max, bool ping_out);
+
+    // Multiply the rows x depth block in plm_mid by a cols x depth block of B2
+    // in the ping/pong PLM, into plm_out
+    inline void chain_block(uint32_t rows, uint32_t cols, uint32_t depth, bool ping, bool ping_out);
+#endif
+
+#if defined(COMPUTE_SYSTOLIC)
+    // Multiply a rows x depth by depth x cols block pair on the systolic array,
+    // accumulating into plm_out
+    inline void systolic_block(uint32_t rows, uint32_t cols, uint32_t depth, uint32_t panel_base,
+                               bool b_stationary, bool ping, bool ping_out, bool first,
+                               int32_t precision);
+#endif
+
     // Private local memories
-    sc_dt::sc_int<DATA_WIDTH> plm_in_ping[PLM_IN_WORD];
-    sc_dt::sc_int<DATA_WIDTH> plm_in_pong[PLM_IN_WORD];
+    sc_dt::sc_int<DATA_WIDTH> plm_in_ping[COMPUTE_LANES][PLM_IN_WORD];
+    sc_dt::sc_int<DATA_WIDTH> plm_in_pong[COMPUTE_LANES][PLM_IN_WORD];
+    sc_dt::sc_int<DATA_WIDTH> plm_panel[PLM_PANEL_WORD];
+    sc_dt::sc_int<DATA_WIDTH> plm_bias[PLM_BIAS_WORD];
+    sc_dt::sc_int<DATA_WIDTH> plm_bitmap[BITMAP_COPIES][PLM_BITMAP_WORD];
     sc_dt::sc_int<DATA_WIDTH> plm_out_ping[PLM_OUT_WORD];
     sc_dt::sc_int<DATA_WIDTH> plm_out_pong[PLM_OUT_WORD];
+#if defined(GEMM_CHAIN)
+    sc_dt::sc_int<DATA_WIDTH> plm_mid[PLM_OUT_WORD];
+#endif
 
 };
 
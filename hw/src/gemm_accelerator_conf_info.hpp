@@ -6,6 +6,22 @@
 
 #include <systemc.h>
 
+// Fraction bits of the Q-format fixed-point datapath
+#ifndef FX_FRAC_BITS
+#define FX_FRAC_BITS 16
+#endif
+
+// 1 in the accumulator format of the datapath (datapath_t::ONE), the default
+// alpha. A driver must write it too: the registers reset to 0, and alpha 0
+// gives C = beta x C
+#if defined(DATAPATH_FX)
+#define ACC_ONE (1 << FX_FRAC_BITS)
+#elif defined(DATAPATH_BF16)
+#define ACC_ONE 0x3f800000
+#else
+#define ACC_ONE 1
+#endif
+
 //
 // Configuration parameters for the accelerator.
 //
@@ -22,19 +38,106 @@ public:
         this->gemm_m = 64;
         this->gemm_n = 64;
         this->gemm_k = 64;
+        this->transpose_b = 0;
+        this->precision = 0;
+        this->bias = 0;
+        this->activation = 0;
+        this->clamp_min = 0;
+        this->clamp_max = 0;
+        this->rq_scale = 0;
+        this->rq_shift = 0;
+        this->alpha = ACC_ONE;
+        this->beta = 0;
+        this->batch_count = 1;
+        this->stride_a = 0;
+        this->stride_b = 0;
+        this->stride_c = 0;
+        this->lda = 0;
+        this->ldb = 0;
+        this->ldc = 0;
+        this->a_offset = 0;
+        this->b_offset = 0;
+        this->c_offset = 0;
+        this->sparse_b = 0;
+        this->sparse_24 = 0;
+        this->perf = 0;
+        this->chain = 0;
+        this->gemm_p = 64;
+        this->b2_offset = 0;
+        this->jobs = 0;
+        this->desc_offset = 0;
+        this->notify = 0;
     }
 
     conf_info_t(
         /* <<--ctor-args-->> */
         int32_t gemm_m, 
         int32_t gemm_n, 
-        int32_t gemm_k
+        int32_t gemm_k, 
+        int32_t transpose_b, 
+        int32_t precision, 
+        int32_t bias, 
+        int32_t activation, 
+        int32_t clamp_min, 
+        int32_t clamp_max, 
+        int32_t rq_scale, 
+        int32_t rq_shift, 
+        int32_t alpha, 
+        int32_t beta, 
+        int32_t batch_count, 
+        int32_t stride_a, 
+        int32_t stride_b, 
+        int32_t stride_c, 
+        int32_t lda, 
+        int32_t ldb, 
+        int32_t ldc, 
+        int32_t a_offset, 
+        int32_t b_offset, 
+        int32_t c_offset, 
+        int32_t sparse_b, 
+        int32_t sparse_24, 
+        int32_t perf, 
+        int32_t chain, 
+        int32_t gemm_p, 
+        int32_t b2_offset, 
+        int32_t jobs, 
+        int32_t desc_offset, 
+        int32_t notify
         )
     {
         /* <<--ctor-custom-->> */
         this->gemm_m = gemm_m;
         this->gemm_n = gemm_n;
         this->gemm_k = gemm_k;
+        this->transpose_b = transpose_b;
+        this->precision = precision;
+        this->bias = bias;
+        this->activation = activation;
+        this->clamp_min = clamp_min;
+        this->clamp_max = clamp_max;
+        this->rq_scale = rq_scale;
+        this->rq_shift = rq_shift;
+        this->alpha = alpha;
+        this->beta = beta;
+        this->batch_count = batch_count;
+        this->stride_a = stride_a;
+        this->stride_b = stride_b;
+        this->stride_c = stride_c;
+        this->lda = lda;
+        this->ldb = ldb;
+        this->ldc = ldc;
+        this->a_offset = a_offset;
+        this->b_offset = b_offset;
+        this->c_offset = c_offset;
+        this->sparse_b = sparse_b;
+        this->sparse_24 = sparse_24;
+        this->perf = perf;
+        this->chain = chain;
+        this->gemm_p = gemm_p;
+        this->b2_offset = b2_offset;
+        this->jobs = jobs;
+        this->desc_offset = desc_offset;
+        this->notify = notify;
     }
 
     // equals operator
@@ -44,6 +147,35 @@ public:
         if (gemm_m != rhs.gemm_m) return false;
         if (gemm_n != rhs.gemm_n) return false;
         if (gemm_k != rhs.gemm_k) return false;
+        if (transpose_b != rhs.transpose_b) return false;
+        if (precision != rhs.precision) return false;
+        if (bias != rhs.bias) return false;
+        if (activation != rhs.activation) return false;
+        if (clamp_min != rhs.clamp_min) return false;
+        if (clamp_max != rhs.clamp_max) return false;
+        if (rq_scale != rhs.rq_scale) return false;
+        if (rq_shift != rhs.rq_shift) return false;
+        if (alpha != rhs.alpha) return false;
+        if (beta != rhs.beta) return false;
+        if (batch_count != rhs.batch_count) return false;
+        if (stride_a != rhs.stride_a) return false;
+        if (stride_b != rhs.stride_b) return false;
+        if (stride_c != rhs.stride_c) return false;
+        if (lda != rhs.lda) return false;
+        if (ldb != rhs.ldb) return false;
+        if (ldc != rhs.ldc) return false;
+        if (a_offset != rhs.a_offset) return false;
+        if (b_offset != rhs.b_offset) return false;
+        if (c_offset != rhs.c_offset) return false;
+        if (sparse_b != rhs.sparse_b) return false;
+        if (sparse_24 != rhs.sparse_24) return false;
+        if (perf != rhs.perf) return false;
+        if (chain != rhs.chain) return false;
+        if (gemm_p != rhs.gemm_p) return false;
+        if (b2_offset != rhs.b2_offset) return false;
+        if (jobs != rhs.jobs) return false;
+        if (desc_offset != rhs.desc_offset) return false;
+        if (notify != rhs.notify) return false;
         return true;
     }
 
@@ -54,6 +186,35 @@ public:
         gemm_m = other.gemm_m;
         gemm_n = other.gemm_n;
         gemm_k = other.gemm_k;
+        transpose_b = other.transpose_b;
+        precision = other.precision;
+        bias = other.bias;
+        activation = other.activation;
+        clamp_min = other.clamp_min;
+        clamp_max = other.clamp_max;
+        rq_scale = other.rq_scale;
+        rq_shift = other.rq_shift;
+        alpha = other.alpha;
+        beta = other.beta;
+        batch_count = other.batch_count;
+        stride_a = other.stride_a;
+        stride_b = other.stride_b;
+        stride_c = other.stride_c;
+        lda = other.lda;
+        ldb = other.ldb;
+        ldc = other.ldc;
+        a_offset = other.a_offset;
+        b_offset = other.b_offset;
+        c_offset = other.c_offset;
+        sparse_b = other.sparse_b;
+        sparse_24 = other.sparse_24;
+        perf = other.perf;
+        chain = other.chain;
+        gemm_p = other.gemm_p;
+        b2_offset = other.b2_offset;
+        jobs = other.jobs;
+        desc_offset = other.desc_offset;
+        notify = other.notify;
         return *this;
     }
 
@@ -68,7 +229,36 @@ public:
         /* <<--print-->> */
         os << "gemm_m = " << conf_info.gemm_m << ", ";
         os << "gemm_n = " << conf_info.gemm_n << ", ";
-        os << "gemm_k = " << conf_info.gemm_k << "";
+        os << "gemm_k = " << conf_info.gemm_k << ", ";
+        os << "transpose_b = " << conf_info.transpose_b << ", ";
+        os << "precision = " << conf_info.precision << ", ";
+        os << "bias = " << conf_info.bias << ", ";
+        os << "activation = " << conf_info.activation << ", ";
+        os << "clamp_min = " << conf_info.clamp_min << ", ";
+        os << "clamp_max = " << conf_info.clamp_max << ", ";
+        os << "rq_scale = " << conf_info.rq_scale << ", ";
+        os << "rq_shift = " << conf_info.rq_shift << ", ";
+        os << "alpha = " << conf_info.alpha << ", ";
+        os << "beta = " << conf_info.beta << ", ";
+        os << "batch_count = " << conf_info.batch_count << ", ";
+        os << "stride_a = " << conf_info.stride_a << ", ";
+        os << "stride_b = " << conf_info.stride_b << ", ";
+        os << "stride_c = " << conf_info.stride_c << ", ";
+        os << "lda = " << conf_info.lda << ", ";
+        os << "ldb = " << conf_info.ldb << ", ";
+        os << "ldc = " << conf_info.ldc << ", ";
+        os << "a_offset = " << conf_info.a_offset << ", ";
+        os << "b_offset = " << conf_info.b_offset << ", ";
+        os << "c_offset = " << conf_info.c_offset << ", ";
+        os << "sparse_b = " << conf_info.sparse_b << ", ";
+        os << "sparse_24 = " << conf_info.sparse_24 << ", ";
+        os << "perf = " << conf_info.perf << ", ";
+        os << "chain = " << conf_info.chain << ", ";
+        os << "gemm_p = " << conf_info.gemm_p << ", ";
+        os << "b2_offset = " << conf_info.b2_offset << ", ";
+        os << "jobs = " << conf_info.jobs << ", ";
+        os << "desc_offset = " << conf_info.desc_offset << ", ";
+        os << "notify = " << conf_info.notify << "";
         os << "}";
         return os;
     }
@@ -77,6 +267,35 @@ public:
         int32_t gemm_m;
         int32_t gemm_n;
         int32_t gemm_k;
+        int32_t transpose_b;
+        int32_t precision;
+        int32_t bias;
+        int32_t activation;
+        int32_t clamp_min;
+        int32_t clamp_max;
+        int32_t rq_scale;
+        int32_t rq_shift;
+        int32_t alpha;
+        int32_t beta;
+        int32_t batch_count;
+        int32_t stride_a;
+        int32_t stride_b;
+        int32_t stride_c;
+        int32_t lda;
+        int32_t ldb;
+        int32_t ldc;
+        int32_t a_offset;
+        int32_t b_offset;
+        int32_t c_offset;
+        int32_t sparse_b;
+        int32_t sparse_24;
+        int32_t perf;
+        int32_t chain;
+        int32_t gemm_p;
+        int32_t b2_offset;
+        int32_t jobs;
+        int32_t desc_offset;
+        int32_t notify;
 };
 
 #endif // __GEMM_ACCELERATOR_CONF_INFO_HPP__
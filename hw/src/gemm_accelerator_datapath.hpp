@@ -0,0 +1,313 @@
+// Copyright (c) 2011-2021 Columbia University, System Level Design Group
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __GEMM_ACCELERATOR_DATAPATH_HPP__
+#define __GEMM_ACCELERATOR_DATAPATH_HPP__
+
+//
+// Arithmetic of the MAC pipeline. PLM words and pipeline registers hold raw
+// 32-bit patterns; each datapath interprets them as its elements (what the
+// multipliers consume, possibly several per word) and its accumulator (what
+// the products are summed in). compute_kernel is written against datapath_t,
+// selected at compile time with DATAPATH_FX or DATAPATH_BF16.
+//
+
+// FX_FRAC_BITS, the fraction bits of the Q-format fixed-point datapath, is in
+// gemm_accelerator_conf_info.hpp
+
+// Sum of the products of the LANES signed sub-words packed in a and b
+template <unsigned LANES>
+inline uint32_t dot_word(uint32_t a, uint32_t b)
+{
+    const unsigned LANE_WIDTH = DATA_WIDTH / LANES;
+    int32_t sum = 0;
+
+    for (unsigned lane = 0; lane < LANES; lane++)
+    {
+        HLS_UNROLL_SIMPLE;
+
+        sc_dt::sc_int<LANE_WIDTH> a_lane = a >> (lane * LANE_WIDTH);
+        sc_dt::sc_int<LANE_WIDTH> b_lane = b >> (lane * LANE_WIDTH);
+
+        sum += a_lane * b_lane;
+    }
+
+    return sum;
+}
+
+// Product of two bfloat16 values as an fp32 bit pattern. The 8x8-bit
+// significand product is exact in fp32; subnormals flush to zero and
+// overflow saturates to infinity.
+inline uint32_t bf16_mul(uint32_t a, uint32_t b)
+{
+    uint32_t sign = ((a ^ b) >> 15) & 1;
+    int32_t exp_a = (a >> 7) & 0xff;
+    int32_t exp_b = (b >> 7) & 0xff;
+
+    if (exp_a == 0 || exp_b == 0)
+        return sign << 31;
+
+    uint32_t prod = (((a & 0x7f) | 0x80) * ((b & 0x7f) | 0x80)) & 0xffff;
+    int32_t exp = exp_a + exp_b - 127;
+    uint32_t frac;
+
+    if (prod & 0x8000)
+    {
+        frac = (prod & 0x7fff) << 8;
+        exp++;
+    }
+    else
+    {
+        frac = (prod & 0x3fff) << 9;
+    }
+
+    if (exp <= 0)
+        return sign << 31;
+    if (exp >= 255)
+        return (sign << 31) | 0x7f800000;
+
+    return (sign << 31) | (exp << 23) | frac;
+}
+
+// Sum of two fp32 bit patterns, rounded to nearest even. Subnormals flush to
+// zero and overflow saturates to infinity; NaNs are not generated.
+inline uint32_t fp32_add(uint32_t a, uint32_t b)
+{
+    // order the operands so that |a| >= |b|
+    if ((b & 0x7fffffff) > (a & 0x7fffffff))
+    {
+        uint32_t tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    uint32_t sign = a >> 31;
+    int32_t exp_a = (a >> 23) & 0xff;
+    int32_t exp_b = (b >> 23) & 0xff;
+
+    if (exp_a == 0)
+        return a & b & 0x80000000;
+    if (exp_b == 0)
+        return a;
+    if (exp_a == 255)
+        return a;
+
+    // significands with the hidden bit and guard, round and sticky bits
+    uint32_t sig_a = ((a & 0x7fffff) | 0x800000) << 3;
+    uint32_t sig_b = ((b & 0x7fffff) | 0x800000) << 3;
+    uint32_t shift = exp_a - exp_b;
+
+    if (shift > 26)
+        sig_b = 1;
+    else
+        sig_b = (sig_b >> shift) | ((sig_b & ((1u << shift) - 1)) != 0);
+
+    uint32_t sig;
+    int32_t exp = exp_a;
+
+    if ((a ^ b) >> 31)
+    {
+        sig = sig_a - sig_b;
+        if (sig == 0)
+            return 0;
+
+        // normalize after cancellation: count the leading zeros of the 27-bit result
+        uint32_t lz = 0;
+        bool found = false;
+        for (int bit = 26; bit >= 0; bit--)
+        {
+            HLS_UNROLL_SIMPLE;
+            if (!found && ((sig >> bit) & 1))
+            {
+                found = true;
+                lz = 26 - bit;
+            }
+        }
+        sig <<= lz;
+        exp -= lz;
+    }
+    else
+    {
+        sig = sig_a + sig_b;
+        if (sig >> 27)
+        {
+            sig = (sig >> 1) | (sig & 1);
+            exp++;
+        }
+    }
+
+    // round to nearest, ties to even
+    uint32_t low = sig & 7;
+    sig >>= 3;
+    if (low > 4 || (low == 4 && (sig & 1)))
+    {
+        sig++;
+        if (sig >> 24)
+        {
+            sig >>= 1;
+            exp++;
+        }
+    }
+
+    if (exp <= 0)
+        return sign << 31;
+    if (exp >= 255)
+        return (sign << 31) | 0x7f800000;
+
+    return (sign << 31) | (exp << 23) | (sig & 0x7fffff);
+}
+
+// Product of two fp32 bit patterns, rounded to nearest even. Subnormals flush
+// to zero and overflow saturates to infinity.
+inline uint32_t fp32_mul(uint32_t a, uint32_t b)
+{
+    uint32_t sign = (a ^ b) >> 31;
+    int32_t exp_a = (a >> 23) & 0xff;
+    int32_t exp_b = (b >> 23) & 0xff;
+
+    if (exp_a == 0 || exp_b == 0)
+        return sign << 31;
+    if (exp_a == 255 || exp_b == 255)
+        return (sign << 31) | 0x7f800000;
+
+    // 48-bit product of the significands, normalized so that bit 47 is set
+    uint64_t prod = (uint64_t) ((a & 0x7fffff) | 0x800000) * ((b & 0x7fffff) | 0x800000);
+    int32_t exp = exp_a + exp_b - 127;
+
+    if (prod >> 47)
+        exp++;
+    else
+        prod <<= 1;
+
+    // round to nearest, ties to even
+    uint32_t sig = prod >> 24;
+    uint32_t low = prod & 0xffffff;
+    if (low > 0x800000 || (low == 0x800000 && (sig & 1)))
+    {
+        sig++;
+        if (sig >> 24)
+        {
+            sig >>= 1;
+            exp++;
+        }
+    }
+
+    if (exp <= 0)
+        return sign << 31;
+    if (exp >= 255)
+        return (sign << 31) | 0x7f800000;
+
+    return (sign << 31) | (exp << 23) | (sig & 0x7fffff);
+}
+
+// Integer: int32, or packed int16/int8 selected by the precision parameter;
+// int32 accumulation, wrapping around on overflow
+struct datapath_int
+{
+    // 1 in the accumulator format
+    static const uint32_t ONE = 1;
+
+    // a precision out of range, or packed wider than PACK_MAX, runs as int32
+    // like mul below
+    static inline int32_t log2_lanes(int32_t precision)
+    {
+#if (PACK_MAX >= 4)
+        if (precision == PRECISION_INT8)
+            return 2;
+#endif
+#if (PACK_MAX >= 2)
+        if (precision == PRECISION_INT16)
+            return 1;
+#endif
+        return 0;
+    }
+
+    static inline uint32_t mul(uint32_t a, uint32_t b, int32_t precision)
+    {
+#if (PACK_MAX >= 4)
+        if (precision == PRECISION_INT8)
+            return dot_word<4>(a, b);
+#endif
+#if (PACK_MAX >= 2)
+        if (precision == PRECISION_INT16)
+            return dot_word<2>(a, b);
+#endif
+        return a * b;
+    }
+
+    static inline uint32_t add(uint32_t a, uint32_t b)
+    {
+        return a + b;
+    }
+
+    // accumulator times a scalar in the accumulator format
+    static inline uint32_t scale(uint32_t acc, uint32_t s)
+    {
+        return acc * s;
+    }
+};
+
+// Fixed point: signed Q(31-FX_FRAC_BITS).FX_FRAC_BITS elements; products are
+// truncated back to the same format and accumulated with wrap-around
+struct datapath_fx
+{
+    static const uint32_t ONE = 1 << FX_FRAC_BITS;
+
+    static inline int32_t log2_lanes(int32_t precision)
+    {
+        return 0;
+    }
+
+    static inline uint32_t mul(uint32_t a, uint32_t b, int32_t precision)
+    {
+        sc_dt::sc_int<2 * DATA_WIDTH> prod = (int64_t) (int32_t) a * (int32_t) b;
+
+        return (uint32_t) (prod >> FX_FRAC_BITS);
+    }
+
+    static inline uint32_t add(uint32_t a, uint32_t b)
+    {
+        return a + b;
+    }
+
+    static inline uint32_t scale(uint32_t acc, uint32_t s)
+    {
+        return mul(acc, s, 0);
+    }
+};
+
+// bfloat16 multiply, fp32 accumulate: every word packs two bf16 elements
+struct datapath_bf16
+{
+    static const uint32_t ONE = 0x3f800000;
+
+    static inline int32_t log2_lanes(int32_t precision)
+    {
+        return 1;
+    }
+
+    static inline uint32_t mul(uint32_t a, uint32_t b, int32_t precision)
+    {
+        return fp32_add(bf16_mul(a & 0xffff, b & 0xffff), bf16_mul(a >> 16, b >> 16));
+    }
+
+    static inline uint32_t add(uint32_t a, uint32_t b)
+    {
+        return fp32_add(a, b);
+    }
+
+    static inline uint32_t scale(uint32_t acc, uint32_t s)
+    {
+        return fp32_mul(acc, s);
+    }
+};
+
+#if defined(DATAPATH_FX)
+typedef datapath_fx datapath_t;
+#elif defined(DATAPATH_BF16)
+typedef datapath_bf16 datapath_t;
+#else
+typedef datapath_int datapath_t;
+#endif
+
+#endif // __GEMM_ACCELERATOR_DATAPATH_HPP__
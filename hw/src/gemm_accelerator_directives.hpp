@@ -7,15 +7,35 @@
 #if (DMA_WIDTH == 32)
 #define DMA_BEAT_PER_WORD 1
 #define DMA_WORD_PER_BEAT 1
-#define PLM_IN_NAME "gemm_accelerator_plm_block_in_dma32"
-#define PLM_OUT_NAME "gemm_accelerator_plm_block_out_dma32"
 #elif (DMA_WIDTH == 64)
 #define DMA_BEAT_PER_WORD 1
 #define DMA_WORD_PER_BEAT 2
-#define PLM_IN_NAME "gemm_accelerator_plm_block_in_dma64"
-#define PLM_OUT_NAME "gemm_accelerator_plm_block_out_dma64"
+#elif (DMA_WIDTH == 128)
+#define DMA_BEAT_PER_WORD 1
+#define DMA_WORD_PER_BEAT 4
+#elif (DMA_WIDTH == 256)
+#define DMA_BEAT_PER_WORD 1
+#define DMA_WORD_PER_BEAT 8
 #endif
 
+#define __PLM_STR(_x) #_x
+#define PLM_STR(_x) __PLM_STR(_x)
+
+// PLMs are generated per block size, port count and DMA width (memlist.txt);
+// with SPARSE_24 the input PLMs serve 2 * PLM_PORTS words of A per cycle
+#if defined(SPARSE_24)
+#define PLM_SUFFIX "_s24"
+#else
+#define PLM_SUFFIX ""
+#endif
+#define PLM_NAME(_kind) "gemm_accelerator_plm_block_" _kind \
+    "_b" PLM_STR(BLOCK_SIZE) "_p" PLM_STR(PLM_PORTS) "_dma" PLM_STR(DMA_WIDTH) PLM_SUFFIX
+#define PLM_IN_NAME PLM_NAME("in")
+#define PLM_PANEL_NAME PLM_NAME("panel")
+#define PLM_OUT_NAME PLM_NAME("out")
+#define PLM_BIAS_NAME PLM_NAME("bias")
+#define PLM_BITMAP_NAME PLM_NAME("bitmap")
+
 
 #if defined(STRATUS_HLS)
 
@@ -36,6 +56,12 @@
 
 #if defined(HLS_DIRECTIVES_BASIC)
 
+#elif defined(HLS_DIRECTIVES_SYSTOLIC)
+
+#if !defined(COMPUTE_SYSTOLIC)
+#error HLS_DIRECTIVES_SYSTOLIC needs the systolic engine (COMPUTE_SYSTOLIC)
+#endif
+
 #else
 
 #error Unsupported or undefined HLS configuration
@@ -4,3 +4,713 @@
 #include "gemm_accelerator.hpp"
 
 // Optional application-specific helper functions
+
+inline void gemm_accelerator::load_compute_sync()
+{
+    load_state.write(PROC_WAIT_NEXT);
+    this->load_compute_handshake();
+    load_state.write(PROC_BUSY);
+}
+
+inline void gemm_accelerator::compute_load_sync()
+{
+    compute_state.write(PROC_WAIT_PREV);
+    this->compute_load_handshake();
+    compute_state.write(PROC_BUSY);
+}
+
+inline void gemm_accelerator::compute_store_sync()
+{
+    compute_state.write(PROC_WAIT_NEXT);
+    this->compute_store_handshake();
+    compute_state.write(PROC_BUSY);
+}
+
+inline void gemm_accelerator::store_compute_sync()
+{
+    store_state.write(PROC_WAIT_PREV);
+    this->store_compute_handshake();
+    store_state.write(PROC_BUSY);
+}
+
+inline void gemm_accelerator::read_request(uint32_t offset, uint32_t words)
+{
+    // the enclosing beats, from the one holding the first word
+    uint32_t skip = offset % DMA_WORD_PER_BEAT;
+    uint32_t beats = (skip + words + DMA_WORD_PER_BEAT - 1) / DMA_WORD_PER_BEAT;
+
+    dma_info_t dma_info(offset / DMA_WORD_PER_BEAT, beats, DMA_SIZE);
+#if DMA_READ_AHEAD > 0
+    this->read_queue.put(dma_info);
+#else
+    this->dma_read_ctrl.put(dma_info);
+#endif
+
+    // DMA beats requested since reset, for the performance counters
+    read_beats.write(read_beats.read() + beats);
+}
+
+inline void gemm_accelerator::load_block(uint32_t offset, uint32_t row_stride, uint32_t rows, uint32_t cols,
+                                         bool transposed, bool to_panel, uint32_t slot, bool ping)
+{
+    uint32_t panel_base = slot * PLM_OUT_WORD;
+
+    // columns past the edge of the matrix are zeroed up to the next K slice
+    // boundary (K_PAD words), so a partial K block adds nothing to the dot products
+    uint32_t cols_pad = round_up(cols, K_PAD);
+
+    // a transposed block is stored in memory one PLM column per burst
+    uint32_t lines = transposed ? cols : rows;
+    uint32_t line_len = transposed ? rows : cols;
+
+    // Lines as long as their pitch abut in memory: the whole block (up to
+    // PLM_OUT_WORD words) is then fetched in a single burst. Whole beats per
+    // line keep the words of a beat in distinct PLM banks across a line break
+    bool contiguous = (line_len == row_stride) && (line_len % DMA_WORD_PER_BEAT == 0);
+    uint32_t bursts = contiguous ? 1 : lines;
+    uint32_t burst_len = contiguous ? lines * line_len : line_len;
+
+    // each new row (or column) of the block, or all of them at once, with the
+    // requests of up to DMA_READ_AHEAD bursts queued ahead of the data
+    uint32_t queued = 0;
+    for (uint32_t burst = 0; burst < bursts; burst++)
+    {
+        while (queued < bursts && queued < burst + READ_AHEAD_BURSTS)
+        {
+            wait();
+            read_request(offset + (queued * row_stride), burst_len);
+            queued++;
+        }
+
+        wait();
+
+        // a burst may start in the middle of a DMA beat: drop the leading words
+        uint32_t skip = (offset + (burst * row_stride)) % DMA_WORD_PER_BEAT;
+        uint32_t beats = (skip + burst_len + DMA_WORD_PER_BEAT - 1) / DMA_WORD_PER_BEAT;
+
+        // line and position in the line of the next word, which wraps to the
+        // next line within a coalesced burst
+        uint32_t line = burst;
+        uint32_t pos = 0;
+
+        for (uint32_t beat = 0; beat < beats; beat++)
+        {
+            HLS_BREAK_DEP(plm_in_ping);
+            HLS_BREAK_DEP(plm_in_pong);
+            HLS_BREAK_DEP(plm_panel);
+
+            sc_dt::sc_bv<DMA_WIDTH> dataBv;
+
+            dataBv = this->dma_read_chnl.get();
+            wait();
+
+            if (transposed)
+            {
+                // Transpose into the PLM: the words of a beat land BLOCK_SIZE
+                // apart, in the same bank, so write one word per cycle
+                for (uint32_t k = 0; k < DMA_WORD_PER_BEAT; k++)
+                {
+                    uint32_t word = beat * DMA_WORD_PER_BEAT + k;
+                    uint32_t plm_index = (pos * BLOCK_SIZE) + line;
+
+                    if (word >= skip && word - skip < burst_len)
+                    {
+                        wait();
+                        write_in(plm_index, dataBv.range((k+1) * DATA_WIDTH - 1, k * DATA_WIDTH).to_int64(), to_panel, panel_base, ping);
+                        pos++;
+                        if (pos == line_len)
+                        {
+                            pos = 0;
+                            line++;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                // Write to PLM (all DMA_WORD_PER_BEAT words in one cycle)
+                for (uint32_t k = 0; k < DMA_WORD_PER_BEAT; k++)
+                {
+                    uint32_t word = beat * DMA_WORD_PER_BEAT + k;
+                    uint32_t plm_index = (line * BLOCK_SIZE) + pos;
+                    HLS_UNROLL_SIMPLE;
+                    if (word >= skip && word - skip < burst_len)
+                    {
+                        write_in(plm_index, dataBv.range((k+1) * DATA_WIDTH - 1, k * DATA_WIDTH).to_int64(), to_panel, panel_base, ping);
+                        pos++;
+                        if (pos == line_len)
+                        {
+                            pos = 0;
+                            line++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // zero-fill the K tail of a partial block
+    for (uint32_t row_num = 0; row_num < rows; row_num++)
+    {
+        for (uint32_t col = cols; col < cols_pad; col++)
+        {
+            HLS_BREAK_DEP(plm_in_ping);
+            HLS_BREAK_DEP(plm_in_pong);
+            HLS_BREAK_DEP(plm_panel);
+
+            uint32_t plm_index = (row_num * BLOCK_SIZE) + col;
+
+            wait();
+            write_in(plm_index, 0, to_panel, panel_base, ping);
+        }
+    }
+}
+
+inline void gemm_accelerator::write_in(uint32_t plm_index, int32_t word, bool to_panel, uint32_t panel_base, bool ping)
+{
+    if (to_panel)
+    {
+        plm_panel[panel_base + plm_index] = word;
+        return;
+    }
+
+    // the lanes own separate PLMs, so all the copies are written in parallel
+    for (uint32_t lane = 0; lane < COMPUTE_LANES; lane++)
+    {
+        HLS_UNROLL_SIMPLE;
+
+        if (ping)
+            plm_in_ping[lane][plm_index] = word;
+        else
+            plm_in_pong[lane][plm_index] = word;
+    }
+}
+
+inline void gemm_accelerator::load_bias(uint32_t offset, uint32_t cols, uint32_t slot)
+{
+    // the slice starts on a DMA beat: the bias vector is beat aligned, and
+    // BLOCK_SIZE is a multiple of the words per beat
+    uint32_t beats = (cols + DMA_WORD_PER_BEAT - 1) / DMA_WORD_PER_BEAT;
+
+    wait();
+
+    read_request(offset, beats * DMA_WORD_PER_BEAT);
+
+    for (uint32_t beat = 0; beat < beats; beat++)
+    {
+        HLS_BREAK_DEP(plm_bias);
+
+        sc_dt::sc_bv<DMA_WIDTH> dataBv;
+
+        dataBv = this->dma_read_chnl.get();
+        wait();
+
+        for (uint32_t k = 0; k < DMA_WORD_PER_BEAT; k++)
+        {
+            HLS_UNROLL_SIMPLE;
+            plm_bias[(slot * BLOCK_SIZE) + (beat * DMA_WORD_PER_BEAT) + k] = dataBv.range((k+1) * DATA_WIDTH - 1, k * DATA_WIDTH).to_int64();
+        }
+    }
+}
+
+inline void gemm_accelerator::load_bitmap(uint32_t offset, uint32_t words)
+{
+    // the bitmap is beat aligned, like the bias vector it follows
+    uint32_t beats = (words + DMA_WORD_PER_BEAT - 1) / DMA_WORD_PER_BEAT;
+
+    wait();
+
+    read_request(offset, beats * DMA_WORD_PER_BEAT);
+
+    for (uint32_t beat = 0; beat < beats; beat++)
+    {
+        HLS_BREAK_DEP(plm_bitmap);
+
+        sc_dt::sc_bv<DMA_WIDTH> dataBv;
+
+        dataBv = this->dma_read_chnl.get();
+        wait();
+
+        for (uint32_t k = 0; k < DMA_WORD_PER_BEAT; k++)
+        {
+            HLS_UNROLL_SIMPLE;
+
+            for (uint32_t copy = 0; copy < BITMAP_COPIES; copy++)
+            {
+                HLS_UNROLL_SIMPLE;
+                plm_bitmap[copy][(beat * DMA_WORD_PER_BEAT) + k] = dataBv.range((k+1) * DATA_WIDTH - 1, k * DATA_WIDTH).to_int64();
+            }
+        }
+    }
+}
+
+inline void gemm_accelerator::load_desc(uint32_t offset, conf_info_t &desc)
+{
+    // the descriptors are beat aligned, as DESC_WORDS is a multiple of the
+    // words per beat
+    uint32_t beats = (DESC_FIELDS + DMA_WORD_PER_BEAT - 1) / DMA_WORD_PER_BEAT;
+    int32_t field[DESC_FIELDS];
+
+    wait();
+
+    read_request(offset, beats * DMA_WORD_PER_BEAT);
+
+    for (uint32_t beat = 0; beat < beats; beat++)
+    {
+        sc_dt::sc_bv<DMA_WIDTH> dataBv;
+
+        dataBv = this->dma_read_chnl.get();
+        wait();
+
+        for (uint32_t k = 0; k < DMA_WORD_PER_BEAT; k++)
+        {
+            HLS_UNROLL_SIMPLE;
+            if ((beat * DMA_WORD_PER_BEAT) + k < DESC_FIELDS)
+                field[(beat * DMA_WORD_PER_BEAT) + k] = dataBv.range((k+1) * DATA_WIDTH - 1, k * DATA_WIDTH).to_int64();
+        }
+    }
+
+    desc.gemm_m = field[0];
+    desc.gemm_n = field[1];
+    desc.gemm_k = field[2];
+    desc.transpose_b = field[3];
+    desc.precision = field[4];
+    desc.bias = field[5];
+    desc.activation = field[6];
+    desc.clamp_min = field[7];
+    desc.clamp_max = field[8];
+    desc.rq_scale = field[9];
+    desc.rq_shift = field[10];
+    desc.alpha = field[11];
+    desc.beta = field[12];
+    desc.batch_count = field[13];
+    desc.stride_a = field[14];
+    desc.stride_b = field[15];
+    desc.stride_c = field[16];
+    desc.lda = field[17];
+    desc.ldb = field[18];
+    desc.ldc = field[19];
+    desc.a_offset = field[20];
+    desc.b_offset = field[21];
+    desc.c_offset = field[22];
+    desc.sparse_b = field[23];
+    desc.sparse_24 = field[24];
+    desc.perf = field[25];
+    desc.chain = field[26];
+    desc.gemm_p = field[27];
+    desc.b2_offset = field[28];
+}
+
+inline bool gemm_accelerator::tile_nonzero(uint32_t copy, uint32_t n_block_k, uint32_t num_n, uint32_t num_k)
+{
+    // tiles are numbered along K first, as B is stored (N x K)
+    uint32_t tile = (num_n * n_block_k) + num_k;
+    uint32_t word = plm_bitmap[copy][tile / 32];
+
+    return (word >> (tile % 32)) & 1;
+}
+
+inline bool gemm_accelerator::step_needed(bool tile_nz, bool keep_last, bool b_stationary, uint32_t n_block_k,
+                                          uint32_t n_block_inner, uint32_t num_inner, uint32_t num_k)
+{
+    if (tile_nz)
+        return true;
+
+    // An output block with a bias keeps its last step if no other one ran: the
+    // bias slices are loaded once per output block, and the handshake keeps
+    // them from overwriting a slot the store phase still reads
+    if (keep_last && num_k == n_block_k - 1)
+        return true;
+
+    // The stationary operand streams through two slots (see panel_slot)
+    if (n_block_k > PANEL_BLOCKS)
+        return false;
+
+    // A whole A panel is fetched on the first pass over it, whatever B holds
+    if (!b_stationary && num_inner == 0)
+        return true;
+
+    // Keep the first step of every panel, and the last one when a single panel
+    // fits, so that a new panel never overwrites the slot in use
+    if (num_inner == 0 && num_k == 0)
+        return true;
+
+    return (2 * n_block_k > PANEL_BLOCKS) && (num_inner == n_block_inner - 1) && (num_k == n_block_k - 1);
+}
+
+inline uint32_t gemm_accelerator::epilogue(uint32_t acc, uint32_t bias_word, int32_t bias, int32_t activation,
+                                           int32_t clamp_min, int32_t clamp_max, int32_t rq_scale, int32_t rq_shift)
+{
+    uint32_t value = acc;
+
+    if (bias)
+        value = datapath_t::add(value, bias_word);
+
+    // the sign bit is in the same place for the integer, fixed-point and fp32
+    // accumulators
+    if (activation == ACT_RELU && (value >> (DATA_WIDTH - 1)))
+        value = 0;
+
+#if !defined(DATAPATH_BF16)
+    // clamp and requantization are integer operations
+    if (activation == ACT_CLAMP)
+    {
+        int32_t clamped = value;
+        if (clamped < clamp_min)
+            clamped = clamp_min;
+        if (clamped > clamp_max)
+            clamped = clamp_max;
+        value = clamped;
+    }
+
+    // requantize to int8: scale, round half up, shift and saturate; the shift
+    // is clamped to [0, 31] as the register is not checked
+    if (rq_scale != 0)
+    {
+        if (rq_shift < 0)
+            rq_shift = 0;
+        if (rq_shift > 31)
+            rq_shift = 31;
+        int64_t scaled = (int64_t) (int32_t) value * rq_scale;
+        if (rq_shift > 0)
+            scaled += (int64_t) 1 << (rq_shift - 1);
+        scaled >>= rq_shift;
+        if (scaled < -128)
+            scaled = -128;
+        if (scaled > 127)
+            scaled = 127;
+        value = (int32_t) scaled;
+    }
+#endif
+
+    return value;
+}
+
+inline void gemm_accelerator::scale_output(uint32_t rows, uint32_t cols, uint32_t alpha, uint32_t beta,
+                                           bool load_c, bool empty, bool ping, bool ping_out)
+{
+    // PLM_PORTS words of a row (one per bank) per cycle; columns past the edge
+    // of a partial block are not stored
+    for (uint32_t row = 0; row < rows; row++)
+    {
+        for (uint32_t col = 0; col < cols; col += PLM_PORTS)
+        {
+            HLS_PIPELINE_LOOP(HARD_STALL, 1, "scale_output");
+
+            for (uint32_t elem = 0; elem < PLM_PORTS; elem++)
+            {
+                HLS_UNROLL_SIMPLE;
+                HLS_BREAK_DEP(plm_out_ping);
+                HLS_BREAK_DEP(plm_out_pong);
+
+                uint32_t index = (row * BLOCK_SIZE) + col + elem;
+
+                // no K step wrote an empty output block
+                uint32_t acc;
+                if (empty)
+                    acc = 0;
+                else if (ping_out)
+                    acc = plm_out_ping[index];
+                else
+                    acc = plm_out_pong[index];
+
+                uint32_t value = datapath_t::scale(acc, alpha);
+
+                if (load_c)
+                {
+                    uint32_t word_c;
+                    if (ping)
+                        word_c = plm_in_ping[0][index];
+                    else
+                        word_c = plm_in_pong[0][index];
+
+                    value = datapath_t::add(value, datapath_t::scale(word_c, beta));
+                }
+
+                if (ping_out)
+                    plm_out_ping[index] = value;
+                else
+                    plm_out_pong[index] = value;
+            }
+        }
+    }
+}
+
+inline uint32_t gemm_accelerator::panel_slot(uint32_t n_block_k, uint32_t num_panel, uint32_t num_k, bool ping)
+{
+    // Two whole panels fit: alternate between them across outer iterations,
+    // so the next panel can be fetched while the last one is still in use
+    if (2 * n_block_k <= PANEL_BLOCKS)
+        return (num_panel & 1) * n_block_k + num_k;
+
+    // One whole panel fits: every K block keeps its own slot
+    if (n_block_k <= PANEL_BLOCKS)
+        return num_k;
+
+    // The panel does not fit: stream the stationary operand through two slots
+    return ping ? 0 : 1;
+}
+
+inline uint32_t gemm_accelerator::block_extent(uint32_t dim, uint32_t num_block)
+{
+    uint32_t left = dim - num_block * BLOCK_SIZE;
+
+    return (left < BLOCK_SIZE) ? left : BLOCK_SIZE;
+}
+
+#if defined(GEMM_CHAIN)
+inline void gemm_accelerator::chain_intermediate(uint32_t rows, uint32_t cols, int32_t activation,
+                                                 int32_t clamp_min, int32_t clamp_max, bool ping_out)
+{
+    // PLM_PORTS words of a row per cycle, as in scale_output; the intermediate
+    // gets the activation only
+    for (uint32_t row = 0; row < rows; row++)
+    {
+        for (uint32_t col = 0; col < cols; col += PLM_PORTS)
+        {
+            HLS_PIPELINE_LOOP(HARD_STALL, 1, "chain_intermediate");
+
+            for (uint32_t elem = 0; elem < PLM_PORTS; elem++)
+            {
+                HLS_UNROLL_SIMPLE;
+                HLS_BREAK_DEP(plm_mid);
+
+                uint32_t index = (row * BLOCK_SIZE) + col + elem;
+
+                uint32_t acc;
+                if (ping_out)
+                    acc = plm_out_ping[index];
+                else
+                    acc = plm_out_pong[index];
+
+                plm_mid[index] = epilogue(acc, 0, 0, activation, clamp_min, clamp_max, 0, 0);
+            }
+        }
+    }
+}
+
+inline void gemm_accelerator::chain_block(uint32_t rows, uint32_t cols, uint32_t depth, bool ping, bool ping_out)
+{
+    // One output word per PLM_PORTS-word slice of the intermediate row, on a
+    // dot product with adder tree like the basic engine. B2 is zero past depth
+    // up to the next slice (see load_block)
+    uint32_t n_slice = (depth + PLM_PORTS - 1) / PLM_PORTS;
+
+    for (uint32_t row = 0; row < rows; row++)
+    {
+        for (uint32_t col = 0; col < cols; col++)
+        {
+            uint32_t acc = 0;
+
+            for (uint32_t slice = 0; slice < n_slice; slice++)
+            {
+                HLS_PIPELINE_LOOP(HARD_STALL, 1, "chain_mac");
+
+                uint32_t regs_tree[PLM_PORTS];
+                HLS_FLATTEN_ARRAY(regs_tree);
+
+                for (uint32_t elem = 0; elem < PLM_PORTS; elem++)
+                {
+                    HLS_UNROLL_SIMPLE;
+                    HLS_BREAK_DEP(plm_mid);
+                    HLS_BREAK_DEP(plm_in_ping);
+                    HLS_BREAK_DEP(plm_in_pong);
+
+                    uint32_t k = (slice * PLM_PORTS) + elem;
+                    uint32_t word_b2;
+                    if (ping)
+                        word_b2 = plm_in_ping[0][(col * BLOCK_SIZE) + k];
+                    else
+                        word_b2 = plm_in_pong[0][(col * BLOCK_SIZE) + k];
+
+                    regs_tree[elem] = datapath_t::mul(plm_mid[(row * BLOCK_SIZE) + k], word_b2, PRECISION_INT32);
+                }
+
+                for (uint32_t len = PLM_PORTS / 2; len > 0; len /= 2)
+                {
+                    HLS_UNROLL_SIMPLE;
+
+                    for (uint32_t i = 0; i < len; i++)
+                    {
+                        HLS_UNROLL_SIMPLE;
+
+                        regs_tree[i] = datapath_t::add(regs_tree[2 * i], regs_tree[2 * i + 1]);
+                    }
+                }
+
+                acc = datapath_t::add(acc, regs_tree[0]);
+            }
+
+            if (ping_out)
+                plm_out_ping[(row * BLOCK_SIZE) + col] = acc;
+            else
+                plm_out_pong[(row * BLOCK_SIZE) + col] = acc;
+        }
+    }
+}
+#endif
+
+#if defined(COMPUTE_SYSTOLIC)
+inline void gemm_accelerator::systolic_block(uint32_t rows, uint32_t cols, uint32_t depth, uint32_t panel_base,
+                                             bool b_stationary, bool ping, bool ping_out, bool first,
+                                             int32_t precision)
+{
+    // Operands move one PE to the right (A) and one PE down (B) per cycle, each
+    // A word carrying a flag that marks it as part of the K extent
+    uint32_t regs_a[SA_DIM][SA_DIM];
+    uint32_t regs_b[SA_DIM][SA_DIM];
+    bool regs_valid[SA_DIM][SA_DIM];
+    uint32_t regs_acc[SA_DIM][SA_DIM];
+    HLS_FLAT(regs_a);
+    HLS_FLAT(regs_b);
+    HLS_FLAT(regs_valid);
+    HLS_FLAT(regs_acc);
+
+    uint32_t n_tile_m = (rows + SA_DIM - 1) / SA_DIM;
+    uint32_t n_tile_n = (cols + SA_DIM - 1) / SA_DIM;
+
+    for (uint32_t tile_m = 0; tile_m < n_tile_m; tile_m++)
+    {
+        for (uint32_t tile_n = 0; tile_n < n_tile_n; tile_n++)
+        {
+            uint32_t out_base = tile_m * SA_DIM * BLOCK_SIZE + tile_n * SA_DIM;
+
+            // the stationary operand is read from the panel, the other from ping/pong
+            uint32_t panel_row = (b_stationary ? tile_n : tile_m) * SA_DIM;
+            uint32_t in_row = (b_stationary ? tile_m : tile_n) * SA_DIM;
+
+            // shift the partial sums of the previous K blocks in, bottom row first
+            for (uint32_t row = 0; row < SA_DIM; row++)
+            {
+                HLS_PIPELINE_LOOP(HARD_STALL, 1, "systolic_acc_in");
+
+                for (uint32_t i = 0; i < SA_DIM - 1; i++)
+                {
+                    HLS_UNROLL_SIMPLE;
+                    for (uint32_t j = 0; j < SA_DIM; j++)
+                    {
+                        HLS_UNROLL_SIMPLE;
+                        regs_acc[i][j] = regs_acc[i + 1][j];
+                    }
+                }
+
+                for (uint32_t j = 0; j < SA_DIM; j++)
+                {
+                    HLS_UNROLL_SIMPLE;
+                    HLS_BREAK_DEP(plm_out_ping);
+                    HLS_BREAK_DEP(plm_out_pong);
+
+                    uint32_t out_index = out_base + row * BLOCK_SIZE + j;
+
+                    if (first)
+                        regs_acc[SA_DIM - 1][j] = 0;
+                    else if (ping_out)
+                        regs_acc[SA_DIM - 1][j] = plm_out_ping[out_index];
+                    else
+                        regs_acc[SA_DIM - 1][j] = plm_out_pong[out_index];
+                }
+            }
+
+            for (uint32_t i = 0; i < SA_DIM; i++)
+            {
+                HLS_UNROLL_SIMPLE;
+                for (uint32_t j = 0; j < SA_DIM; j++)
+                {
+                    HLS_UNROLL_SIMPLE;
+                    regs_valid[i][j] = false;
+                }
+            }
+
+            // depth words of K, plus the skew to fill and drain the array
+            for (uint32_t t = 0; t < depth + 2 * (SA_DIM - 1); t++)
+            {
+                HLS_PIPELINE_LOOP(HARD_STALL, 1, "systolic_step");
+
+                // operands advance through the array (last PE first)
+                for (uint32_t i = 0; i < SA_DIM; i++)
+                {
+                    HLS_UNROLL_SIMPLE;
+                    for (uint32_t j = SA_DIM - 1; j > 0; j--)
+                    {
+                        HLS_UNROLL_SIMPLE;
+                        regs_a[i][j] = regs_a[i][j - 1];
+                        regs_valid[i][j] = regs_valid[i][j - 1];
+                        regs_b[j][i] = regs_b[j - 1][i];
+                    }
+                }
+
+                // skewed feeders: lane i enters word t - i of its row. The rows
+                // start on a BLOCK_SIZE boundary, so the lanes hit the distinct
+                // banks (t - i) % PLM_PORTS and all read in the same cycle
+                for (uint32_t i = 0; i < SA_DIM; i++)
+                {
+                    HLS_UNROLL_SIMPLE;
+                    HLS_BREAK_DEP(plm_in_ping);
+                    HLS_BREAK_DEP(plm_in_pong);
+                    HLS_BREAK_DEP(plm_panel);
+
+                    uint32_t k = t - i;
+                    bool valid = t >= i && k < depth;
+                    uint32_t panel_index = panel_base + (panel_row + i) * BLOCK_SIZE + (valid ? k : 0);
+                    uint32_t in_index = (in_row + i) * BLOCK_SIZE + (valid ? k : 0);
+
+                    uint32_t word_panel = plm_panel[panel_index];
+                    uint32_t word_in;
+                    if (ping)
+                        word_in = plm_in_ping[0][in_index];
+                    else
+                        word_in = plm_in_pong[0][in_index];
+
+                    regs_a[i][0] = b_stationary ? word_in : word_panel;
+                    regs_b[0][i] = b_stationary ? word_panel : word_in;
+                    regs_valid[i][0] = valid;
+                }
+
+                // PE (i, j) now holds A[i][k] and B[j][k] for k = t - i - j
+                for (uint32_t i = 0; i < SA_DIM; i++)
+                {
+                    HLS_UNROLL_SIMPLE;
+                    for (uint32_t j = 0; j < SA_DIM; j++)
+                    {
+                        HLS_UNROLL_SIMPLE;
+
+                        if (regs_valid[i][j])
+                            regs_acc[i][j] = datapath_t::add(regs_acc[i][j],
+                                                             datapath_t::mul(regs_a[i][j], regs_b[i][j], precision));
+                    }
+                }
+            }
+
+            // shift the accumulators out to plm_out, top row first
+            for (uint32_t row = 0; row < SA_DIM; row++)
+            {
+                HLS_PIPELINE_LOOP(HARD_STALL, 1, "systolic_acc_out");
+
+                for (uint32_t j = 0; j < SA_DIM; j++)
+                {
+                    HLS_UNROLL_SIMPLE;
+                    HLS_BREAK_DEP(plm_out_ping);
+                    HLS_BREAK_DEP(plm_out_pong);
+
+                    uint32_t out_index = out_base + row * BLOCK_SIZE + j;
+
+                    if (ping_out)
+                        plm_out_ping[out_index] = regs_acc[0][j];
+                    else
+                        plm_out_pong[out_index] = regs_acc[0][j];
+                }
+
+                for (uint32_t i = 0; i < SA_DIM - 1; i++)
+                {
+                    HLS_UNROLL_SIMPLE;
+                    for (uint32_t j = 0; j < SA_DIM; j++)
+                    {
+                        HLS_UNROLL_SIMPLE;
+                        regs_acc[i][j] = regs_acc[i + 1][j];
+                    }
+                }
+            }
+        }
+    }
+}
+#endif
@@ -2,8 +2,45 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <sstream>
+#include <cstring>
+#include <algorithm>
 #include "system.hpp"
 
+// Random matrix element, as a bit pattern of the datapath element type
+static int32_t rand_elem(int32_t gemm_k, uint32_t lane_width)
+{
+#if defined(DATAPATH_FX)
+    // fixed-point value in [-4, 4)
+    return (rand() % (8 << FX_FRAC_BITS)) - (4 << FX_FRAC_BITS);
+#elif defined(DATAPATH_BF16)
+    // bfloat16 value in [-1, 1)
+    float value = 2.0f * rand() / RAND_MAX - 1.0f;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits >> 16;
+#else
+    // full-range signed values when packed
+    if (lane_width == DATA_WIDTH)
+        return rand() % gemm_k;
+    return (rand() & ((1 << lane_width) - 1)) - (1 << (lane_width - 1));
+#endif
+}
+
+// Random bias or C element, as a bit pattern of the datapath accumulator type
+static int32_t rand_acc(int32_t gemm_k)
+{
+#if defined(DATAPATH_FX)
+    return (rand() % (64 << FX_FRAC_BITS)) - (32 << FX_FRAC_BITS);
+#elif defined(DATAPATH_BF16)
+    float value = 8.0f * rand() / RAND_MAX - 4.0f;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+#else
+    return (rand() % (2 * gemm_k * gemm_k)) - gemm_k * gemm_k;
+#endif
+}
+
 // Process
 void system_t::config_proc()
 {
@@ -26,6 +63,35 @@ void system_t::config_proc()
         config.gemm_m = gemm_m;
         config.gemm_n = gemm_n;
         config.gemm_k = gemm_k;
+        config.transpose_b = transpose_b;
+        config.precision = precision;
+        config.bias = bias;
+        config.activation = activation;
+        config.clamp_min = clamp_min;
+        config.clamp_max = clamp_max;
+        config.rq_scale = rq_scale;
+        config.rq_shift = rq_shift;
+        config.alpha = alpha;
+        config.beta = beta;
+        config.batch_count = batch_count;
+        config.stride_a = stride_a;
+        config.stride_b = stride_b;
+        config.stride_c = stride_c;
+        config.lda = lda;
+        config.ldb = ldb;
+        config.ldc = ldc;
+        config.a_offset = a_offset;
+        config.b_offset = b_offset;
+        config.c_offset = c_offset;
+        config.sparse_b = sparse_b;
+        config.sparse_24 = sparse_24;
+        config.perf = perf;
+        config.chain = chain;
+        config.gemm_p = gemm_p;
+        config.b2_offset = b2_offset;
+        config.jobs = jobs;
+        config.desc_offset = desc_offset;
+        config.notify = notify;
 
         wait(); conf_info.write(config);
         conf_done.write(true);
@@ -49,11 +115,17 @@ void system_t::config_proc()
 
         esc_log_latency(sc_object::basename(), clock_cycle(end_time - begin_time));
         wait(); conf_done.write(false);
+
+        report_dma();
+        report_bursts();
+        report_cycles(clock_cycle(end_time - begin_time));
     }
 
     // Validate
     {
         dump_memory(); // store the output in more suitable data structure if needed
+        if (perf)
+            report_perf();
         // check the results with the golden model
         if (validate())
         {
@@ -75,40 +147,455 @@ void system_t::load_memory()
 {
     // Optional usage check
 #ifdef CADENCE
-    if (esc_argc() != 1)
+    // positional arguments, in this order; gemm_m, gemm_n and gemm_k go together
+    int32_t *args[] = { &gemm_m, &gemm_n, &gemm_k, &transpose_b, &precision,
+                        &bias, &activation, &clamp_min, &clamp_max, &rq_scale, &rq_shift,
+                        &alpha, &beta, &batch_count, &stride_a, &stride_b, &stride_c,
+                        &lda, &ldb, &ldc, &sparse_b, &sparsity, &sparse_24, &chain, &gemm_p,
+                        &jobs, &desc_offset, &notify };
+    int n_args = sizeof(args) / sizeof(args[0]);
+    if (esc_argc() != 1 && (esc_argc() < 4 || esc_argc() > n_args + 1))
+    {
+        ESP_REPORT_INFO("usage: %s [gemm_m gemm_n gemm_k [transpose_b [precision [bias [activation "
+                        "[clamp_min [clamp_max [rq_scale [rq_shift [alpha [beta [batch_count [stride_a [stride_b "
+                        "[stride_c [lda [ldb [ldc [sparse_b [sparsity [sparse_24 [chain [gemm_p [jobs [desc_offset "
+                        "[notify]]]]]]]]]]]]]]]]]]]]]]]]]]\n", esc_argv()[0]);
+        sc_stop();
+    }
+    for (int i = 1; i < esc_argc() && i <= n_args; i++)
+        *args[i - 1] = atoi(esc_argv()[i]);
+#endif
+
+    // Any shape is accepted, but output rows must start on a DMA beat
+    if (gemm_n % DMA_WORD_PER_BEAT != 0 || (chain && gemm_p % DMA_WORD_PER_BEAT != 0))
     {
-        ESP_REPORT_INFO("usage: %s\n", esc_argv()[0]);
+        ESP_REPORT_INFO("gemm_n and gemm_p must be multiples of %d with DMA_WIDTH %d\n", DMA_WORD_PER_BEAT, DMA_WIDTH);
+        sc_stop();
+    }
+
+    // A fused chain keeps a whole row of blocks of A x B on chip, and runs on
+    // the 32-bit datapath only
+#if !defined(GEMM_CHAIN)
+    if (chain)
+    {
+        ESP_REPORT_INFO("chain needs the GEMM_CHAIN configuration\n");
         sc_stop();
     }
 #endif
+    if (chain && (gemm_n > BLOCK_SIZE || precision != PRECISION_INT32 || beta != 0 || batch_count != 1 ||
+                  sparse_b || sparse_24))
+    {
+        ESP_REPORT_INFO("chain needs gemm_n <= %d, 32-bit elements, a single dense GEMM and beta 0\n", BLOCK_SIZE);
+        sc_stop();
+    }
+
+    // the output is A x B, or D (gemm_m x gemm_p) with chain
+    uint32_t cols_out = chain ? gemm_p : gemm_n;
+
+    // K is counted in 32-bit words, each packing 1, 2 or 4 elements
+    uint32_t lanes = 1 << datapath_t::log2_lanes(precision);
+    uint32_t lane_width = DATA_WIDTH / lanes;
+    uint32_t lane_mask = (lane_width == 32) ? 0xffffffff : ((1u << lane_width) - 1);
+    gemm_kw = (gemm_k + lanes - 1) / lanes;
+    uint32_t n_block_n = (gemm_n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t n_block_k = (gemm_kw + BLOCK_SIZE - 1) / BLOCK_SIZE;
 
-    // Input data and golden output (aligned to DMA_WIDTH makes your life easier)
+    // A 2:4 sparse B is stored N x K, compressed to SPARSE_24_WORDS per K block
+#if !defined(SPARSE_24)
+    if (sparse_24)
+    {
+        ESP_REPORT_INFO("sparse_24 needs the SPARSE_24 datapath\n");
+        sc_stop();
+    }
+#endif
+    if (sparse_24 && transpose_b)
+    {
+        ESP_REPORT_INFO("a 2:4 sparse B cannot be transposed\n");
+        sc_stop();
+    }
+    uint32_t row_b = sparse_24 ? n_block_k * SPARSE_24_WORDS : (transpose_b ? gemm_n : gemm_kw);
+
+    // Row pitches, packed rows by default (as with 0 in the registers)
+    if (lda == 0)
+        lda = gemm_kw;
+    if (ldb == 0)
+        ldb = row_b;
+    if (ldc == 0)
+        ldc = cols_out;
+    uint32_t rows_b = transpose_b ? gemm_kw : gemm_n;
+    if (lda < gemm_kw || ldb < row_b || ldc < cols_out)
+    {
+        ESP_REPORT_INFO("lda, ldb and ldc must cover a whole row\n");
+        sc_stop();
+    }
+
+    // Unless given, the matrices of the batch are packed back to back; a zero
+    // stride shares one A (or B) across the batch
+    if (stride_a < 0)
+        stride_a = gemm_m * lda;
+    if (stride_b < 0)
+        stride_b = rows_b * ldb;
 #if (DMA_WORD_PER_BEAT == 0)
-    in_words_adj = (gemm_m * gemm_k) + (gemm_n * gemm_k);
-    out_words_adj = gemm_m * gemm_n;
+    if (stride_c < 0)
+        stride_c = gemm_m * ldc;
 #else
-    in_words_adj = round_up((gemm_m * gemm_k) + (gemm_n * gemm_k), DMA_WORD_PER_BEAT);
-    out_words_adj = round_up(gemm_m * gemm_n, DMA_WORD_PER_BEAT);
+    if (stride_c < 0)
+        stride_c = round_up(gemm_m * ldc, DMA_WORD_PER_BEAT);
 #endif
 
+    if (stride_c % DMA_WORD_PER_BEAT != 0 || ldc % DMA_WORD_PER_BEAT != 0)
+    {
+        ESP_REPORT_INFO("stride_c and ldc must be multiples of %d with DMA_WIDTH %d\n", DMA_WORD_PER_BEAT, DMA_WIDTH);
+        sc_stop();
+    }
+
+    // Input data and golden output (aligned to DMA_WIDTH makes your life easier).
+    // Unless given, the A matrices come first, then the B matrices and the bias,
+    // then the outputs
+#if (DMA_WORD_PER_BEAT == 0)
+    uint32_t beat_words = 1;
+#else
+    uint32_t beat_words = DMA_WORD_PER_BEAT;
+#endif
+    uint32_t a_words = ((batch_count - 1) * stride_a) + (gemm_m * lda);
+    uint32_t b_words = ((batch_count - 1) * stride_b) + (rows_b * ldb);
+    if (a_offset < 0)
+        a_offset = 0;
+    if (b_offset < 0)
+        b_offset = a_offset + a_words;
+
+    // With chain, B2 (gemm_p x gemm_n, packed) follows the B matrix, beat
+    // aligned unless given
+    uint32_t in_end = b_offset + b_words;
+    if (chain && b2_offset < 0)
+        b2_offset = round_up(in_end, beat_words);
+    if (chain)
+        in_end = b2_offset + gemm_p * gemm_n;
+
+    // The bias vector follows the B matrices (B2 with chain), beat aligned
+    uint32_t bias_words = round_up(in_end, beat_words);
+    in_end = bias ? round_up(bias_words + cols_out, beat_words) : bias_words;
+
+    // With sparse_b, the tile bitmap of B (one bit per tile, along K first)
+    // follows the bias, beat aligned
+    uint32_t bitmap_words = in_end;
+    if (sparse_b)
+        in_end = round_up(bitmap_words + (n_block_n * n_block_k + 31) / 32, beat_words);
+
+    if (sparse_b && n_block_n * n_block_k > 32 * PLM_BITMAP_WORD)
+    {
+        ESP_REPORT_INFO("at most %d tiles of B with sparse_b\n", 32 * PLM_BITMAP_WORD);
+        sc_stop();
+    }
+
+    in_words_adj = round_up(std::max(a_offset + a_words, in_end), beat_words);
+    out_words_adj = round_up(((batch_count - 1) * stride_c) + (gemm_m * ldc), beat_words);
+    if (c_offset < 0)
+        c_offset = in_words_adj;
+
+    if (c_offset % beat_words != 0)
+    {
+        ESP_REPORT_INFO("c_offset must be a multiple of %d with DMA_WIDTH %d\n", beat_words, DMA_WIDTH);
+        sc_stop();
+    }
+
+    // With a descriptor ring, job j computes the first job_rows(j) rows of
+    // the output (all of them in the last job), into its own copy of the C
+    // matrices job_words after the one of job j - 1
+    job_words = round_up(out_words_adj + PERF_WORDS, beat_words);
+    uint32_t out_jobs = jobs ? (jobs - 1) * job_words : 0;
+
+    // with perf, the counters follow the outputs (of the last job)
+    uint32_t c_end = c_offset + out_jobs + out_words_adj + (perf ? round_up(PERF_WORDS, beat_words) : 0);
+    if ((c_offset < a_offset + a_words && a_offset < c_end) ||
+        (c_offset < in_end && b_offset < c_end) ||
+        (chain && c_offset < in_end && b2_offset < c_end))
+    {
+        ESP_REPORT_INFO("the C matrices must not overlap A, B, B2 or the bias\n");
+        sc_stop();
+    }
+
+    // The descriptors follow the outputs unless given
+    if (jobs && desc_offset < 0)
+        desc_offset = round_up(c_end, beat_words);
+    uint32_t desc_end = desc_offset + jobs * DESC_WORDS;
+    if (jobs && desc_offset % beat_words != 0)
+    {
+        ESP_REPORT_INFO("desc_offset must be a multiple of %d with DMA_WIDTH %d\n", beat_words, DMA_WIDTH);
+        sc_stop();
+    }
+    if (jobs && ((desc_offset < a_offset + a_words && a_offset < desc_end) ||
+                 (desc_offset < in_end && b_offset < desc_end) ||
+                 (chain && desc_offset < in_end && b2_offset < desc_end) ||
+                 (desc_offset < c_end && c_offset < desc_end)))
+    {
+        ESP_REPORT_INFO("the descriptors must not overlap the inputs or the outputs\n");
+        sc_stop();
+    }
+
     in_size = in_words_adj * (1);
-    out_size = out_words_adj * (1);
+    out_size = (out_jobs + out_words_adj) * (1);
+
+    // Matrix elements (B as N x K) of every batch; a shared matrix is the one of batch 0
+    int32_t *mat_a = new int32_t[batch_count * gemm_m * gemm_k];
+    int32_t *mat_b = new int32_t[batch_count * gemm_n * gemm_k];
+    for (int j = 0; j < batch_count * gemm_m * gemm_k; j++)
+        mat_a[j] = (stride_a || j < gemm_m * gemm_k) ? rand_elem(gemm_k, lane_width) : mat_a[j % (gemm_m * gemm_k)];
+    for (int j = 0; j < batch_count * gemm_n * gemm_k; j++)
+        mat_b[j] = (stride_b || j < gemm_n * gemm_k) ? rand_elem(gemm_k, lane_width) : mat_b[j % (gemm_n * gemm_k)];
+
+    // Sparse B: whole tiles are zero in every B of the batch, at a random level
+    // unless given
+    tile_nz.assign(n_block_n * n_block_k, true);
+    if (sparse_b)
+    {
+        if (sparsity < 0)
+            sparsity = rand() % 100;
+
+        uint32_t n_zero = 0;
+        for (int t = 0; t < n_block_n * n_block_k; t++)
+        {
+            tile_nz[t] = (rand() % 100) >= sparsity;
+            n_zero += !tile_nz[t];
+        }
+
+        for (int j = 0; j < batch_count * gemm_n * gemm_k; j++)
+        {
+            uint32_t n = (j / gemm_k) % gemm_n;
+            uint32_t kw = (j % gemm_k) / lanes;
+            if (!tile_nonzero(n / BLOCK_SIZE, kw / BLOCK_SIZE))
+                mat_b[j] = 0;
+        }
+
+        ESP_REPORT_INFO("sparse B: %u of %u tiles are zero (level %d%%)", n_zero, n_block_n * n_block_k, sparsity);
+    }
+
+    // 2:4 sparse B: 2 words kept in every group of 4 along K of a row (the same
+    // ones in every B of the batch), as the positions p0 | p1 << 2 with p0 < p1
+    uint32_t groups = n_block_k * BLOCK_SIZE / 4;
+    std::vector<uint8_t> keep(gemm_n * groups);
+    if (sparse_24)
+    {
+        for (int j = 0; j < gemm_n * groups; j++)
+        {
+            uint32_t p0 = rand() % 3;
+            uint32_t p1 = p0 + 1 + rand() % (3 - p0);
+            keep[j] = p0 | (p1 << 2);
+        }
+
+        for (int j = 0; j < batch_count * gemm_n * gemm_k; j++)
+        {
+            uint32_t n = (j / gemm_k) % gemm_n;
+            uint32_t kw = (j % gemm_k) / lanes;
+            uint32_t kept = keep[n * groups + kw / 4];
+            if (kw % 4 != (kept & 3) && kw % 4 != (kept >> 2))
+                mat_b[j] = 0;
+        }
+    }
+
+    // Pack the elements along K; the unused lanes of the last word of a row are zero
+    in = new int32_t[in_size]();
+    for (int i = 0; i < batch_count; i++)
+    {
+        int32_t *a = &mat_a[i * gemm_m * gemm_k];
+        int32_t *b = &mat_b[i * gemm_n * gemm_k];
+        int32_t *in_a = &in[a_offset + i * stride_a];
+        int32_t *in_b = &in[b_offset + i * stride_b];
 
-    in = new int32_t[in_size];
-    for (int i = 0; i < 1; i++)
-        for (int j = 0; j < (gemm_m * gemm_k) + (gemm_n * gemm_k); j++)
-            in[i * in_words_adj + j] = (int32_t) (rand() % gemm_k);
+        for (int kw = 0; kw < gemm_kw; kw++)
+        {
+            for (int m = 0; m < gemm_m; m++)
+            {
+                uint32_t word = 0;
+                for (int lane = 0; lane < lanes && kw * lanes + lane < gemm_k; lane++)
+                    word |= (a[m * gemm_k + kw * lanes + lane] & lane_mask) << (lane * lane_width);
+                in_a[m * lda + kw] = word;
+            }
+            for (int n = 0; n < gemm_n; n++)
+            {
+                // B is stored either transposed (N x K) or row-major (K x N)
+                int b_index = transpose_b ? (kw * ldb + n) : (n * ldb + kw);
+                uint32_t word = 0;
+                for (int lane = 0; lane < lanes && kw * lanes + lane < gemm_k; lane++)
+                    word |= (b[n * gemm_k + kw * lanes + lane] & lane_mask) << (lane * lane_width);
 
-    // Compute golden output
+                // or compressed: only the kept words, BLOCK_SIZE / 2 values per K block
+                uint32_t kept = keep[n * groups + kw / 4];
+                if (sparse_24 && (kw % 4 == (kept & 3) || kw % 4 == (kept >> 2)))
+                    in_b[n * ldb + (kw / BLOCK_SIZE) * SPARSE_24_WORDS + ((kw % BLOCK_SIZE) / 4) * 2 + (kw % 4 == (kept >> 2))] = word;
+                else if (!sparse_24)
+                    in_b[b_index] = word;
+            }
+        }
+
+        // followed by the 2-bit positions of the values, 16 per word
+        for (int n = 0; n < gemm_n && sparse_24; n++)
+            for (int g = 0; g < groups; g++)
+            {
+                uint32_t kept = keep[n * groups + g];
+                uint32_t v = (g % (BLOCK_SIZE / 4)) * 2;
+                int32_t *indices = &in_b[n * ldb + (g / (BLOCK_SIZE / 4)) * SPARSE_24_WORDS + BLOCK_SIZE / 2];
+                indices[v / 16] |= (kept & 3) << (2 * (v % 16));
+                indices[(v + 1) / 16] |= (kept >> 2) << (2 * ((v + 1) % 16));
+            }
+    }
+
+    // Bias, as a bit pattern of the accumulator type
+    for (int n = 0; n < cols_out && bias; n++)
+        in[bias_words + n] = rand_acc(gemm_k);
+
+    // B2 elements, one row of gemm_n words per column of D
+    for (int j = 0; chain && j < gemm_p * gemm_n; j++)
+        in[b2_offset + j] = rand_elem(gemm_n, 32);
+
+    // Tile bitmap, a set bit for every tile that may hold non-zero elements
+    for (int t = 0; t < n_block_n * n_block_k && sparse_b; t++)
+        in[bitmap_words + t / 32] |= (uint32_t) tile_nz[t] << (t % 32);
+
+    // Initial content of the output, scaled by beta and accumulated into; the
+    // words outside the C matrices must be left untouched
+    int32_t *mat_c = new int32_t[out_size];
+    for (int j = 0; j < out_size; j++)
+        mat_c[j] = rand_acc(gemm_k);
+
+    // the same C matrices for every job of the ring
+    for (int j = 1; j < jobs; j++)
+        memcpy(&mat_c[j * job_words], mat_c, out_words_adj * sizeof(int32_t));
+
+    // Compute golden output (through T, the gemm_m x gemm_n intermediate of a chain)
+    std::vector<uint32_t> mid(chain ? gemm_m * gemm_n : 0);
     gold = new int32_t[out_size];
-    for (int i = 0; i < 1; i++)
+    memcpy(gold, mat_c, out_size * sizeof(int32_t));
+    for (int i = 0; i < batch_count; i++)
+    {
+        int32_t *a = &mat_a[i * gemm_m * gemm_k];
+        int32_t *b = &mat_b[i * gemm_n * gemm_k];
+        int32_t *in_a = &in[a_offset + i * stride_a];
+        int32_t *in_b = &in[b_offset + i * stride_b];
+
         for (int m = 0; m < gemm_m; m++)
             for (int n = 0; n < gemm_n; n++) {
-                gold[i * out_words_adj + m * gemm_n + n] = 0;
+                uint32_t acc = 0;
+#if defined(DATAPATH_BF16) && defined(COMPUTE_SYSTOLIC)
+                // the systolic PEs add one product per cycle, in K order; the
+                // zero tiles of a sparse B are skipped
+                for (int kw = 0; kw < gemm_kw; kw++)
+                {
+                    if (!tile_nonzero(n / BLOCK_SIZE, kw / BLOCK_SIZE))
+                        continue;
+                    int b_index = transpose_b ? (kw * ldb + n) : (n * ldb + kw);
+                    acc = datapath_t::add(acc, datapath_t::mul(in_a[m * lda + kw], in_b[b_index], precision));
+                }
+#elif defined(DATAPATH_BF16)
+                // fp32 sums depend on the order: follow the hardware, which adds
+                // the products of PLM_PORTS words (zero past K) with a pairwise
+                // tree and then adds the tree to the accumulator (but not for
+                // the zero tiles of a sparse B)
+                if (sparse_24)
+                {
+                    // 2:4 sparse B: the trees add PLM_PORTS values of a block row,
+                    // each times the A word its index picks
+                    for (int kb = 0; kb < n_block_k; kb++)
+                    {
+                        if (!tile_nonzero(n / BLOCK_SIZE, kb))
+                            continue;
+                        int32_t *row = &in_b[n * ldb + kb * SPARSE_24_WORDS];
+                        uint32_t depth = std::min<uint32_t>(BLOCK_SIZE, gemm_kw - kb * BLOCK_SIZE);
+                        for (int v0 = 0; v0 < round_up(depth, 2 * PLM_PORTS) / 2; v0 += PLM_PORTS)
+                        {
+                            uint32_t tree[PLM_PORTS];
+                            for (int j = 0; j < PLM_PORTS; j++)
+                            {
+                                int v = v0 + j;
+                                int kw = kb * BLOCK_SIZE + (v / 2) * 4 + ((row[BLOCK_SIZE / 2 + v / 16] >> (2 * (v % 16))) & 3);
+                                uint32_t word_a = (kw < gemm_kw) ? in_a[m * lda + kw] : 0;
+                                tree[j] = datapath_t::mul(word_a, row[v], precision);
+                            }
+                            for (int len = PLM_PORTS / 2; len > 0; len /= 2)
+                                for (int j = 0; j < len; j++)
+                                    tree[j] = datapath_t::add(tree[2 * j], tree[2 * j + 1]);
+                            acc = datapath_t::add(acc, tree[0]);
+                        }
+                    }
+                }
+                else
+                {
+                    for (int kw = 0; kw < round_up(gemm_kw, PLM_PORTS); kw += PLM_PORTS)
+                    {
+                        if (!tile_nonzero(n / BLOCK_SIZE, kw / BLOCK_SIZE))
+                            continue;
+                        uint32_t tree[PLM_PORTS];
+                        for (int j = 0; j < PLM_PORTS; j++)
+                        {
+                            int b_index = transpose_b ? ((kw + j) * ldb + n) : (n * ldb + kw + j);
+                            uint32_t word_a = (kw + j < gemm_kw) ? in_a[m * lda + kw + j] : 0;
+                            uint32_t word_b = (kw + j < gemm_kw) ? in_b[b_index] : 0;
+                            tree[j] = datapath_t::mul(word_a, word_b, precision);
+                        }
+                        for (int len = PLM_PORTS / 2; len > 0; len /= 2)
+                            for (int j = 0; j < len; j++)
+                                tree[j] = datapath_t::add(tree[2 * j], tree[2 * j + 1]);
+                        acc = datapath_t::add(acc, tree[0]);
+                    }
+                }
+#elif defined(DATAPATH_FX)
+                // truncated fixed-point products, wrapping around like the accumulators
+                for (int k = 0; k < gemm_k; k++)
+                    acc += (uint32_t) (((int64_t) a[m * gemm_k + k] * b[n * gemm_k + k]) >> FX_FRAC_BITS);
+#else
+                // wrapping around like the 32-bit accumulators
                 for (int k = 0; k < gemm_k; k++)
-                    gold[i * out_words_adj + m * gemm_n + n] +=
-                        in[i * in_words_adj + m * gemm_k + k] * in[i * in_words_adj + gemm_m * gemm_k + n * gemm_k + k];
+                    acc += (uint32_t) (a[m * gemm_k + k] * b[n * gemm_k + k]);
+#endif
+                if (beta != 0 || (uint32_t) alpha != datapath_t::ONE)
+                {
+                    acc = datapath_t::scale(acc, alpha);
+                    if (beta != 0)
+                        acc = datapath_t::add(acc, datapath_t::scale(mat_c[i * stride_c + m * ldc + n], beta));
+                }
+
+                // the intermediate of a chain only goes through the activation
+                if (chain)
+                    mid[m * gemm_n + n] = chain_activation(acc);
+                else
+                    gold[i * stride_c + m * ldc + n] = epilogue(acc, bias ? in[bias_words + n] : 0);
             }
+    }
+
+    // D = T x B2, with the whole epilogue
+    for (int m = 0; m < gemm_m && chain; m++)
+        for (int p = 0; p < gemm_p; p++)
+        {
+            uint32_t acc = 0;
+            for (int n = 0; n < gemm_n; n++)
+                acc = datapath_t::add(acc, datapath_t::mul(mid[m * gemm_n + n], in[b2_offset + p * gemm_n + n],
+                                                           PRECISION_INT32));
+            gold[m * ldc + p] = epilogue(acc, bias ? in[bias_words + p] : 0);
+        }
+
+    // A job leaves the rows past job_rows(j) of its C matrices as they were
+    for (int j = jobs - 1; j >= 0; j--)
+        for (int w = 0; w < out_words_adj; w++)
+        {
+            uint32_t row = (stride_c ? w % stride_c : w) / ldc;
+            gold[j * job_words + w] = (row < job_rows(j)) ? gold[w] : mat_c[w];
+        }
+
+    // Descriptors of the ring: the configuration of the GEMM, with the rows,
+    // the output and the counters of the job
+    std::vector<int32_t> desc(jobs * DESC_WORDS);
+    for (int j = 0; j < jobs; j++)
+    {
+        int32_t fields[DESC_FIELDS] = { (int32_t) job_rows(j), gemm_n, gemm_k, transpose_b, precision,
+                                        bias, activation, clamp_min, clamp_max, rq_scale, rq_shift,
+                                        alpha, beta, batch_count, stride_a, stride_b, stride_c,
+                                        lda, ldb, ldc, a_offset, b_offset, (int32_t) (c_offset + j * job_words),
+                                        sparse_b, sparse_24, perf && j == jobs - 1, chain, gemm_p, b2_offset };
+        memcpy(&desc[j * DESC_WORDS], fields, sizeof(fields));
+    }
+
+    delete [] mat_a;
+    delete [] mat_b;
 
     // Memory initialization:
 #if (DMA_WORD_PER_BEAT == 0)
@@ -117,6 +604,16 @@ void system_t::load_memory()
         for (int j = 0; j < DMA_BEAT_PER_WORD; j++)
             mem[DMA_BEAT_PER_WORD * i + j] = data_bv.range((j + 1) * DMA_WIDTH - 1, j * DMA_WIDTH);
     }
+    for (int i = 0; i < out_size; i++)  {
+        sc_dt::sc_bv<DATA_WIDTH> data_bv(mat_c[i]);
+        for (int j = 0; j < DMA_BEAT_PER_WORD; j++)
+            mem[DMA_BEAT_PER_WORD * (c_offset + i) + j] = data_bv.range((j + 1) * DMA_WIDTH - 1, j * DMA_WIDTH);
+    }
+    for (int i = 0; i < jobs * DESC_WORDS; i++)  {
+        sc_dt::sc_bv<DATA_WIDTH> data_bv(desc[i]);
+        for (int j = 0; j < DMA_BEAT_PER_WORD; j++)
+            mem[DMA_BEAT_PER_WORD * (desc_offset + i) + j] = data_bv.range((j + 1) * DMA_WIDTH - 1, j * DMA_WIDTH);
+    }
 #else
     for (int i = 0; i < in_size / DMA_WORD_PER_BEAT; i++)  {
         sc_dt::sc_bv<DMA_WIDTH> data_bv(in[i]);
@@ -124,8 +621,22 @@ void system_t::load_memory()
             data_bv.range((j+1) * DATA_WIDTH - 1, j * DATA_WIDTH) = in[i * DMA_WORD_PER_BEAT + j];
         mem[i] = data_bv;
     }
+    for (int i = 0; i < out_size / DMA_WORD_PER_BEAT; i++)  {
+        sc_dt::sc_bv<DMA_WIDTH> data_bv;
+        for (int j = 0; j < DMA_WORD_PER_BEAT; j++)
+            data_bv.range((j+1) * DATA_WIDTH - 1, j * DATA_WIDTH) = mat_c[i * DMA_WORD_PER_BEAT + j];
+        mem[c_offset / DMA_WORD_PER_BEAT + i] = data_bv;
+    }
+    for (int i = 0; i < jobs * DESC_WORDS / DMA_WORD_PER_BEAT; i++)  {
+        sc_dt::sc_bv<DMA_WIDTH> data_bv;
+        for (int j = 0; j < DMA_WORD_PER_BEAT; j++)
+            data_bv.range((j+1) * DATA_WIDTH - 1, j * DATA_WIDTH) = desc[i * DMA_WORD_PER_BEAT + j];
+        mem[desc_offset / DMA_WORD_PER_BEAT + i] = data_bv;
+    }
 #endif
 
+    delete [] mat_c;
+
     ESP_REPORT_INFO("load memory completed");
 }
 
@@ -133,7 +644,7 @@ void system_t::dump_memory()
 {
     // Get results from memory
     out = new int32_t[out_size];
-    uint32_t offset = in_size;
+    uint32_t offset = c_offset;
 
 #if (DMA_WORD_PER_BEAT == 0)
     offset = offset * DMA_BEAT_PER_WORD;
@@ -145,25 +656,307 @@ void system_t::dump_memory()
 
         out[i] = data_bv.to_int64();
     }
+    for (int i = 0; perf && i < PERF_WORDS; i++)  {
+        sc_dt::sc_bv<DATA_WIDTH> data_bv;
+
+        for (int j = 0; j < DMA_BEAT_PER_WORD; j++)
+            data_bv.range((j + 1) * DMA_WIDTH - 1, j * DMA_WIDTH) = mem[offset + DMA_BEAT_PER_WORD * (out_size + i) + j];
+
+        perf_count[i] = data_bv.to_uint64();
+    }
+    status.assign(jobs, 0);
+    for (int i = 0; i < jobs; i++)  {
+        sc_dt::sc_bv<DATA_WIDTH> data_bv;
+
+        for (int j = 0; j < DMA_BEAT_PER_WORD; j++)
+            data_bv.range((j + 1) * DMA_WIDTH - 1, j * DMA_WIDTH) =
+                mem[DMA_BEAT_PER_WORD * (desc_offset + i * DESC_WORDS + DESC_STATUS) + j];
+
+        status[i] = data_bv.to_uint64();
+    }
 #else
     offset = offset / DMA_WORD_PER_BEAT;
     for (int i = 0; i < out_size / DMA_WORD_PER_BEAT; i++)
         for (int j = 0; j < DMA_WORD_PER_BEAT; j++)
             out[i * DMA_WORD_PER_BEAT + j] = mem[offset + i].range((j + 1) * DATA_WIDTH - 1, j * DATA_WIDTH).to_int64();
+    offset += out_size / DMA_WORD_PER_BEAT;
+    for (int i = 0; perf && i < PERF_WORDS; i++)
+        perf_count[i] = mem[offset + i / DMA_WORD_PER_BEAT].range((i % DMA_WORD_PER_BEAT + 1) * DATA_WIDTH - 1,
+                                                                  (i % DMA_WORD_PER_BEAT) * DATA_WIDTH).to_uint64();
+    status.assign(jobs, 0);
+    for (int i = 0; i < jobs; i++)
+        status[i] = mem[(desc_offset + i * DESC_WORDS + DESC_STATUS) / DMA_WORD_PER_BEAT].range(DATA_WIDTH - 1, 0).to_uint64();
 #endif
 
     ESP_REPORT_INFO("dump memory completed");
 }
 
+void system_t::report_dma()
+{
+    uint64_t n_block_m = (gemm_m + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint64_t n_block_n = (gemm_n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint64_t n_block_k = (gemm_kw + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint64_t words_a = (uint64_t) gemm_m * gemm_kw;
+    uint64_t words_b = (uint64_t) gemm_n * (sparse_24 ? n_block_k * SPARSE_24_WORDS : gemm_kw);
+
+    // Without reuse A is fetched once per block column of the output, and B
+    // once per block row
+    uint64_t words_naive = n_block_n * words_a + n_block_m * words_b;
+
+    // With reuse each stationary panel is fetched only once, if it fits
+    uint64_t words = words_naive;
+    if (n_block_k <= PANEL_BLOCKS)
+    {
+        if (chain || n_block_m <= n_block_n)
+            words = words_a + n_block_m * words_b;
+        else
+            words = n_block_n * words_a + words_b;
+    }
+
+    // every GEMM of the batch fetches its own operands
+    words *= batch_count;
+    words_naive *= batch_count;
+
+    ESP_REPORT_INFO("input DMA words: %llu (%llu without panel reuse, %llu saved)",
+                    (unsigned long long) words, (unsigned long long) words_naive,
+                    (unsigned long long) (words_naive - words));
+
+    // a chain reads B2 once per block row of A, instead of writing the
+    // intermediate and reading it back
+    if (chain)
+        ESP_REPORT_INFO("chain: %llu intermediate DMA words saved, %llu B2 words read",
+                        (unsigned long long) 2 * gemm_m * gemm_n,
+                        (unsigned long long) n_block_m * gemm_p * gemm_n);
+}
+
+// DMA transactions of the blocks moved by a GEMM, and their number without
+// coalescing
+struct dma_count_t
+{
+    uint64_t bursts = 0;
+    uint64_t bursts_rows = 0;
+};
+
+// A block of lines of line_len words, line_pitch apart (see load_block)
+static void count_bursts(uint32_t lines, uint32_t line_len, uint32_t line_pitch, dma_count_t &count)
+{
+    bool contiguous = (line_len == line_pitch) && (line_len % DMA_WORD_PER_BEAT == 0);
+
+    count.bursts += contiguous ? 1 : lines;
+    count.bursts_rows += lines;
+}
+
+void system_t::report_bursts()
+{
+    uint32_t n_block_m = (gemm_m + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t n_block_n = (gemm_n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t n_block_k = (gemm_kw + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    bool b_stationary = !chain && n_block_n < n_block_m;
+
+    // Read and write transactions of one GEMM of the batch, following the
+    // schedule of load_input and store_output for a dense B
+    dma_count_t reads;
+    dma_count_t writes;
+
+    for (uint32_t num_m = 0; num_m < n_block_m; num_m++)
+        for (uint32_t num_n = 0; num_n < n_block_n; num_n++)
+        {
+            uint32_t rows_a = std::min<uint32_t>(BLOCK_SIZE, gemm_m - num_m * BLOCK_SIZE);
+            uint32_t rows_b = std::min<uint32_t>(BLOCK_SIZE, gemm_n - num_n * BLOCK_SIZE);
+            uint32_t num_inner = b_stationary ? num_m : num_n;
+
+            if (bias)
+                count_bursts(1, rows_b, 0, reads);
+
+            for (uint32_t num_k = 0; num_k < n_block_k; num_k++)
+            {
+                uint32_t cols = std::min<uint32_t>(BLOCK_SIZE, gemm_kw - num_k * BLOCK_SIZE);
+                // the stationary block is only fetched on the first pass over its panel
+                bool first_pass = (num_inner == 0) || (n_block_k > PANEL_BLOCKS);
+                bool load_a = first_pass || b_stationary;
+                bool load_b = first_pass || !b_stationary;
+
+                if (load_a)
+                    count_bursts(rows_a, cols, lda, reads);
+                if (load_b && sparse_24)
+                    count_bursts(rows_b, SPARSE_24_WORDS, ldb, reads);
+                else if (load_b && transpose_b)
+                    count_bursts(cols, rows_b, ldb, reads);
+                else if (load_b)
+                    count_bursts(rows_b, cols, ldb, reads);
+            }
+
+            if (beta != 0)
+                count_bursts(rows_a, rows_b, ldc, reads);
+            count_bursts(rows_a, rows_b, ldc, writes);
+        }
+
+    ESP_REPORT_INFO("DMA transactions per GEMM: %llu reads, %llu writes (%llu and %llu row by row)",
+                    (unsigned long long) reads.bursts, (unsigned long long) writes.bursts,
+                    (unsigned long long) reads.bursts_rows, (unsigned long long) writes.bursts_rows);
+
+    // the tile bitmap of a sparse B is read once for the whole batch
+    ESP_REPORT_INFO("DMA transactions in total: %llu reads, %llu writes",
+                    (unsigned long long) (reads.bursts * batch_count + (sparse_b ? 1 : 0)),
+                    (unsigned long long) (writes.bursts * batch_count));
+}
+
+uint32_t system_t::job_rows(uint32_t job)
+{
+    // a third of the rows less for every other job, down to two thirds
+    return gemm_m - ((jobs - 1 - job) % 3) * (gemm_m / 3);
+}
+
+bool system_t::tile_nonzero(uint32_t num_n, uint32_t num_k)
+{
+    return tile_nz[num_n * ((gemm_kw + BLOCK_SIZE - 1) / BLOCK_SIZE) + num_k];
+}
+
+void system_t::report_cycles(uint64_t cycles)
+{
+    // Cycles spent issuing MACs by each compute engine, summed over all the
+    // block steps (load, store and handshakes are not included), and the same
+    // for a dense B
+    uint64_t basic = 0;
+    uint64_t systolic = 0;
+    uint64_t basic_dense = 0;
+    uint64_t systolic_dense = 0;
+
+    // the basic engine lanes split the sub-blocks of the streamed operand
+    bool b_stationary = !chain && (gemm_n + BLOCK_SIZE - 1) / BLOCK_SIZE < (gemm_m + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    for (uint32_t m = 0; m < gemm_m; m += BLOCK_SIZE)
+        for (uint32_t n = 0; n < gemm_n; n += BLOCK_SIZE)
+            for (uint32_t k = 0; k < gemm_kw; k += BLOCK_SIZE)
+            {
+                uint64_t rows = std::min<uint32_t>(BLOCK_SIZE, gemm_m - m);
+                uint64_t cols = std::min<uint32_t>(BLOCK_SIZE, gemm_n - n);
+                uint64_t depth = std::min<uint32_t>(BLOCK_SIZE, gemm_kw - k);
+                uint64_t sub_m = (rows + PLM_PORTS - 1) / PLM_PORTS;
+                uint64_t sub_n = (cols + PLM_PORTS - 1) / PLM_PORTS;
+
+                if (b_stationary)
+                    sub_m = (sub_m + COMPUTE_LANES - 1) / COMPUTE_LANES;
+                else
+                    sub_n = (sub_n + COMPUTE_LANES - 1) / COMPUTE_LANES;
+
+                // one output word per cycle for each PLM_PORTS-word slice of K
+                // (of 2 * PLM_PORTS words with a 2:4 sparse B)
+                uint64_t slices = sparse_24 ? round_up(depth, 2 * PLM_PORTS) / 2 : round_up(depth, PLM_PORTS);
+                uint64_t basic_step = sub_m * sub_n * PLM_PORTS * slices;
+
+                // per SA_DIM x SA_DIM tile: fill, depth, drain, and accumulators in and out
+                uint64_t systolic_step = ((rows + SA_DIM - 1) / SA_DIM) * ((cols + SA_DIM - 1) / SA_DIM)
+                                         * (depth + 2 * (SA_DIM - 1) + 2 * SA_DIM);
+
+                basic_dense += basic_step;
+                systolic_dense += systolic_step;
+                if (tile_nonzero(n / BLOCK_SIZE, k / BLOCK_SIZE))
+                {
+                    basic += basic_step;
+                    systolic += systolic_step;
+                }
+            }
+
+    basic *= batch_count;
+    systolic *= batch_count;
+    basic_dense *= batch_count;
+    systolic_dense *= batch_count;
+
+#if defined(COMPUTE_SYSTOLIC)
+    ESP_REPORT_INFO("systolic engine (%dx%d PEs): %llu cycles", SA_DIM, SA_DIM, (unsigned long long) cycles);
+#else
+    ESP_REPORT_INFO("basic engine (%d x %d MACs): %llu cycles", COMPUTE_LANES, PLM_PORTS,
+                    (unsigned long long) cycles);
+#endif
+    ESP_REPORT_INFO("compute cycles (model): basic %llu, systolic %llu",
+                    (unsigned long long) basic, (unsigned long long) systolic);
+    if (sparse_b)
+        ESP_REPORT_INFO("skipped zero tiles save %llu basic, %llu systolic cycles",
+                        (unsigned long long) (basic_dense - basic), (unsigned long long) (systolic_dense - systolic));
+
+    // the jobs of a ring follow each other through the pipeline
+    if (jobs)
+        ESP_REPORT_INFO("descriptor ring: %d jobs, %llu cycles per job", jobs, (unsigned long long) (cycles / jobs));
+}
+
+void system_t::report_perf()
+{
+    ESP_REPORT_INFO("load: %u cycles busy, %u stalled on compute",
+                    perf_count[PERF_LOAD_BUSY], perf_count[PERF_LOAD_WAIT_COMPUTE]);
+    ESP_REPORT_INFO("compute: %u cycles busy, %u stalled on load, %u stalled on store",
+                    perf_count[PERF_COMPUTE_BUSY], perf_count[PERF_COMPUTE_WAIT_LOAD],
+                    perf_count[PERF_COMPUTE_WAIT_STORE]);
+    ESP_REPORT_INFO("store: %u cycles busy", perf_count[PERF_STORE_BUSY]);
+    ESP_REPORT_INFO("DMA beats: %u read, %u written", perf_count[PERF_READ_BEATS], perf_count[PERF_WRITE_BEATS]);
+
+    // the engine waiting on the memory phases more than it computes
+    uint32_t stalled = perf_count[PERF_COMPUTE_WAIT_LOAD] + perf_count[PERF_COMPUTE_WAIT_STORE];
+    ESP_REPORT_INFO("%s-bound", (stalled > perf_count[PERF_COMPUTE_BUSY]) ? "memory" : "compute");
+}
+
+uint32_t system_t::epilogue(uint32_t acc, uint32_t bias_word)
+{
+    uint32_t value = bias ? datapath_t::add(acc, bias_word) : acc;
+
+    if (activation == ACT_RELU && (value >> 31))
+        value = 0;
+
+#if !defined(DATAPATH_BF16)
+    if (activation == ACT_CLAMP)
+        value = std::min(std::max((int32_t) value, clamp_min), clamp_max);
+
+    if (rq_scale != 0)
+    {
+        int32_t shift = std::min(std::max(rq_shift, 0), 31);
+        int64_t scaled = (int64_t) (int32_t) value * rq_scale;
+        if (shift > 0)
+            scaled += (int64_t) 1 << (shift - 1);
+        value = std::min<int64_t>(std::max<int64_t>(scaled >> shift, -128), 127);
+    }
+#endif
+
+    return value;
+}
+
+uint32_t system_t::chain_activation(uint32_t acc)
+{
+    uint32_t value = acc;
+
+    if (activation == ACT_RELU && (value >> 31))
+        value = 0;
+
+    if (activation == ACT_CLAMP)
+        value = std::min(std::max((int32_t) value, clamp_min), clamp_max);
+
+    return value;
+}
+
 int system_t::validate()
 {
     // Check for mismatches
     uint32_t errors = 0;
 
-    for (int i = 0; i < 1; i++)
-        for (int j = 0; j < gemm_m * gemm_n; j++)
-            if (gold[i * out_words_adj + j] != out[i * out_words_adj + j])
-                errors++;
+    // the whole output buffer, including the words between rows and batches
+    for (int j = 0; j < out_size; j++)
+        if (gold[j] != out[j])
+        {
+            if (errors < 10)
+                ESP_REPORT_INFO("mismatch at output word %d: %d (gold %d)", j, out[j], gold[j]);
+            errors++;
+        }
+
+    // the status word of every job with notify, else of the last one only
+    for (int j = 0; j < jobs; j++)
+    {
+        uint32_t expected = (notify || j == jobs - 1) ? j + 1 : 0;
+        if (status[j] != expected)
+        {
+            if (errors < 10)
+                ESP_REPORT_INFO("job %d status %u (expected %u)", j, status[j], expected);
+            errors++;
+        }
+    }
 
     delete [] in;
     delete [] out;
@@ -11,6 +11,8 @@
 
 #include "esp_templates.hpp"
 
+#include <vector>
+
 const size_t MEM_SIZE = 64 * 49152 / (DMA_WIDTH/8);
 
 #include "core/systems/esp_system.hpp"
@@ -57,6 +59,42 @@ public:
         gemm_m = 64;
         gemm_n = 64;
         gemm_k = 64;
+        transpose_b = 0;
+        precision = 0;
+        bias = 0;
+        activation = 0;
+        clamp_min = 0;
+        clamp_max = 0;
+        rq_scale = 0;
+        rq_shift = 0;
+        alpha = datapath_t::ONE;
+        beta = 0;
+        batch_count = 1;
+        // -1: matrices packed back to back (see load_memory)
+        stride_a = -1;
+        stride_b = -1;
+        stride_c = -1;
+        lda = 0;
+        ldb = 0;
+        ldc = 0;
+        // -1: A, B (followed by the bias) and C back to back (see load_memory)
+        a_offset = -1;
+        b_offset = -1;
+        c_offset = -1;
+        sparse_b = 0;
+        sparse_24 = 0;
+        // write and report the performance counters
+        perf = 1;
+        chain = 0;
+        gemm_p = 64;
+        // -1: B2 after B (see load_memory)
+        b2_offset = -1;
+        // descriptor ring of jobs GEMMs (see load_memory), -1: after the outputs
+        jobs = 0;
+        desc_offset = -1;
+        notify = 1;
+        // percentage of all-zero B tiles with sparse_b, -1 for a random level
+        sparsity = -1;
     }
 
     // Processes
@@ -78,16 +116,75 @@ public:
     int32_t gemm_m;
     int32_t gemm_n;
     int32_t gemm_k;
-
+    int32_t transpose_b;
+    int32_t precision;
+    int32_t bias;
+    int32_t activation;
+    int32_t clamp_min;
+    int32_t clamp_max;
+    int32_t rq_scale;
+    int32_t rq_shift;
+    int32_t alpha;
+    int32_t beta;
+    int32_t batch_count;
+    int32_t stride_a;
+    int32_t stride_b;
+    int32_t stride_c;
+    int32_t lda;
+    int32_t ldb;
+    int32_t ldc;
+    int32_t a_offset;
+    int32_t b_offset;
+    int32_t c_offset;
+    int32_t sparse_b;
+    int32_t sparse_24;
+    int32_t perf;
+    int32_t chain;
+    int32_t gemm_p;
+    int32_t b2_offset;
+    int32_t jobs;
+    int32_t desc_offset;
+    int32_t notify;
+
+    int32_t sparsity;
+    std::vector<bool> tile_nz;
+    uint32_t gemm_kw;
     uint32_t in_words_adj;
     uint32_t out_words_adj;
     uint32_t in_size;
     uint32_t out_size;
+    uint32_t job_words;
+    std::vector<uint32_t> status;
     int32_t *in;
     int32_t *out;
     int32_t *gold;
+    uint32_t perf_count[PERF_WORDS];
 
     // Other Functions
+
+    // Report the input DMA traffic saved by keeping the stationary panel in the PLM
+    void report_dma();
+
+    // Report the DMA transactions of a GEMM, with and without coalesced bursts
+    void report_bursts();
+
+    // Golden bias, activation and requantization of an output word
+    uint32_t epilogue(uint32_t acc, uint32_t bias_word);
+
+    // Golden activation of a word of the intermediate of a chain
+    uint32_t chain_activation(uint32_t acc);
+
+    // Rows of the output computed by job job of the descriptor ring
+    uint32_t job_rows(uint32_t job);
+
+    // Whether B tile (num_n, num_k) holds non-zero elements (always with a dense B)
+    bool tile_nonzero(uint32_t num_n, uint32_t num_k);
+
+    // Report the measured latency next to the compute cycles of both engines
+    void report_cycles(uint64_t cycles);
+
+    // Report the performance counters written after the output
+    void report_perf();
 };
 
 #endif // __SYSTEM_HPP__
@@ -10,11 +10,26 @@
 
 typedef int32_t token_t;
 
+/* DMA width of the accelerator in bits (64, 128 or 256), which may be wider
+ * than the CPU: the bias, the bitmap and the output start on its beats */
+#define ACC_DMA_WIDTH 64
+
 static unsigned DMA_WORD_PER_BEAT(unsigned _st)
 {
-        return (sizeof(void *) / _st);
+        return ((ACC_DMA_WIDTH / 8) / _st);
 }
 
+/* Performance counters written after the output with perf: cycles of load
+ * busy and stalled on compute, of compute busy and stalled on load and on
+ * store, of store busy, then the DMA beats read and written */
+#define PERF_WORDS 8
+
+/* Descriptor ring with jobs: per job, the gemm_m to b2_offset fields of the
+ * configuration in register order, then the status word the accelerator
+ * writes when the job is done (the number of jobs done so far) */
+#define DESC_FIELDS 29
+#define DESC_STATUS 32
+#define DESC_WORDS 40
 
 #define SLD_GEMM_ACCELERATOR 0x095
 #define DEV_NAME "sld,gemm_accelerator_stratus"
@@ -23,14 +38,75 @@ static unsigned DMA_WORD_PER_BEAT(unsigned _st)
 const int32_t gemm_m = 64;
 const int32_t gemm_n = 64;
 const int32_t gemm_k = 64;
-
+const int32_t transpose_b = 0;
+/* 0: int32, 1: 2 x int16 per word, 2: 4 x int8 per word */
+const int32_t precision = 0;
+/* 1: add the per-column bias vector stored after the inputs */
+const int32_t bias = 0;
+/* 0: none, 1: ReLU, 2: clamp to [CLAMP_MIN, CLAMP_MAX] */
+const int32_t activation = 0;
+const int32_t clamp_min = 0;
+const int32_t clamp_max = 0;
+/* Requantization to int8, (x * RQ_SCALE) >> RQ_SHIFT, off when RQ_SCALE is 0 */
+const int32_t rq_scale = 0;
+const int32_t rq_shift = 0;
+/* C = alpha * A x B + beta * C, in the accumulator format (one is 1 for
+ * integers, 1 << 16 for fixed point and 0x3f800000 for bf16). It must be
+ * written: the registers reset to 0, and alpha 0 gives beta * C */
+const int32_t alpha = 1;
+/* beta != 0 reads C from the output buffer */
+const int32_t beta = 0;
+/* Number of GEMMs in the batch */
+const int32_t batch_count = 1;
+/* Words between the A (B, C) matrices of consecutive batches; -1 packs them
+ * back to back at the row pitches below, 0 reuses the same A (B). stride_c
+ * must be beat aligned */
+static int32_t stride_a = -1;
+static int32_t stride_b = -1;
+static int32_t stride_c = -1;
+/* Row pitch of A (B, C) in words, 0 for packed rows; ldc must be beat aligned */
+const int32_t lda = 0;
+const int32_t ldb = 0;
+const int32_t ldc = 0;
+/* Skip the B tiles cleared in the tile bitmap (after the bias) */
+const int32_t sparse_b = 0;
+/* B is 2:4 sparse, in the compressed format (needs SPARSE_24 hardware) */
+const int32_t sparse_24 = 0;
+/* 1: write the performance counters after the output */
+const int32_t perf = 0;
+/* 1: D = act(A x B) x B2 on chip, with GEMM_N <= TILE_SIZE (needs GEMM_CHAIN hardware) */
+const int32_t chain = 0;
+/* Columns of D, and rows of B2 (stored GEMM_P x GEMM_N) */
+const int32_t gemm_p = 64;
+/* Jobs in the descriptor ring, run back to back (0: no ring) */
+const int32_t jobs = 0;
+/* 1: write the status word of every job, 0: of the last one only */
+const int32_t notify = 0;
+/* Edge of the tiles in the bitmap and of the 2:4 compressed rows, the
+ * BLOCK_SIZE of the accelerator */
+#define TILE_SIZE 64
+
+static unsigned gemm_kw;
+static unsigned out_cols;
+static unsigned pitch_a;
+static unsigned pitch_b;
+static unsigned pitch_c;
+/* Word offsets of A, B (followed by B2 with chain, and the bias) and C in mem */
+static unsigned a_offset;
+static unsigned b_offset;
+static unsigned b2_offset;
+static unsigned desc_offset;
 static unsigned in_words_adj;
+static unsigned bias_offset;
+static unsigned bitmap_offset;
 static unsigned out_words_adj;
 static unsigned in_len;
 static unsigned out_len;
 static unsigned in_size;
 static unsigned out_size;
-static unsigned out_offset;
+static unsigned c_offset;
+static unsigned perf_offset;
+static unsigned job_len;
 static unsigned mem_size;
 
 uint32_t checkpoint[10];
@@ -47,6 +123,35 @@ uint32_t checkpoint[10];
 #define GEMM_ACCELERATOR_GEMM_M_REG 0x48
 #define GEMM_ACCELERATOR_GEMM_N_REG 0x44
 #define GEMM_ACCELERATOR_GEMM_K_REG 0x40
+#define GEMM_ACCELERATOR_TRANSPOSE_B_REG 0x4c
+#define GEMM_ACCELERATOR_PRECISION_REG 0x50
+#define GEMM_ACCELERATOR_BIAS_REG 0x54
+#define GEMM_ACCELERATOR_ACTIVATION_REG 0x58
+#define GEMM_ACCELERATOR_CLAMP_MIN_REG 0x5c
+#define GEMM_ACCELERATOR_CLAMP_MAX_REG 0x60
+#define GEMM_ACCELERATOR_RQ_SCALE_REG 0x64
+#define GEMM_ACCELERATOR_RQ_SHIFT_REG 0x68
+#define GEMM_ACCELERATOR_ALPHA_REG 0x6c
+#define GEMM_ACCELERATOR_BETA_REG 0x70
+#define GEMM_ACCELERATOR_BATCH_COUNT_REG 0x74
+#define GEMM_ACCELERATOR_STRIDE_A_REG 0x78
+#define GEMM_ACCELERATOR_STRIDE_B_REG 0x7c
+#define GEMM_ACCELERATOR_STRIDE_C_REG 0x80
+#define GEMM_ACCELERATOR_LDA_REG 0x84
+#define GEMM_ACCELERATOR_LDB_REG 0x88
+#define GEMM_ACCELERATOR_LDC_REG 0x8c
+#define GEMM_ACCELERATOR_A_OFFSET_REG 0x90
+#define GEMM_ACCELERATOR_B_OFFSET_REG 0x94
+#define GEMM_ACCELERATOR_C_OFFSET_REG 0x98
+#define GEMM_ACCELERATOR_SPARSE_B_REG 0x9c
+#define GEMM_ACCELERATOR_SPARSE_24_REG 0xa0
+#define GEMM_ACCELERATOR_PERF_REG 0xa4
+#define GEMM_ACCELERATOR_CHAIN_REG 0xa8
+#define GEMM_ACCELERATOR_GEMM_P_REG 0xac
+#define GEMM_ACCELERATOR_B2_OFFSET_REG 0xb0
+#define GEMM_ACCELERATOR_JOBS_REG 0xb4
+#define GEMM_ACCELERATOR_DESC_OFFSET_REG 0xb8
+#define GEMM_ACCELERATOR_NOTIFY_REG 0xbc
 
 static inline uint64_t get_counter()
 {
@@ -72,36 +177,212 @@ static int validate_buf(token_t *out, token_t *gold)
 	int j;
 	unsigned errors = 0;
 
-	for (i = 0; i < 1; i++)
-		for (j = 0; j < gemm_m * gemm_n; j++)
-			if (gold[i * out_words_adj + j] != out[i * out_words_adj + j])
+	for (i = 0; i < batch_count; i++)
+		for (j = 0; j < gemm_m * out_cols; j++)
+			if (gold[i * stride_c + (j / out_cols) * pitch_c + (j % out_cols)] !=
+			    out[i * stride_c + (j / out_cols) * pitch_c + (j % out_cols)])
 				errors++;
 
 	return errors;
 }
 
 
+/* ReLU or clamp, also applied to the intermediate of a chain */
+static int32_t activate(int32_t value)
+{
+	if (activation == 1 && value < 0)
+		value = 0;
+	if (activation == 2)
+		value = (value < clamp_min) ? clamp_min : ((value > clamp_max) ? clamp_max : value);
+
+	return value;
+}
+
+
+/* Bias, activation and requantization, as applied by the store phase */
+static token_t epilogue(uint32_t acc, token_t bias_word)
+{
+	int32_t value = activate(bias ? (int32_t) (acc + bias_word) : (int32_t) acc);
+	int64_t scaled;
+
+	/* Requantization to int8: scale, round half up, shift and saturate */
+	if (rq_scale != 0) {
+		scaled = (int64_t) value * rq_scale;
+		if (rq_shift > 0)
+			scaled += (int64_t) 1 << (rq_shift - 1);
+		scaled >>= rq_shift;
+		value = (scaled < -128) ? -128 : ((scaled > 127) ? 127 : scaled);
+	}
+
+	return value;
+}
+
+
 static void init_buf (token_t *in, token_t * gold)
 {
 	int i;
-	int j;
+	int m, n, k, kw, lane;
+	unsigned lanes = 1 << precision;
+	unsigned lane_width = 32 / lanes;
+	unsigned lane_mask = (lane_width == 32) ? 0xffffffff : ((1u << lane_width) - 1);
+	int32_t *mat_a = aligned_malloc(batch_count * gemm_m * gemm_k * sizeof(int32_t));
+	int32_t *mat_b = aligned_malloc(batch_count * gemm_n * gemm_k * sizeof(int32_t));
+	int32_t *mid = chain ? aligned_malloc(gemm_m * gemm_n * sizeof(int32_t)) : NULL;
+	int32_t *a, *b;
+
+	/* Matrix elements (B as N x K) of every batch: full-range signed values when
+	 * packed; a matrix shared by the batch (zero stride) is the one of batch 0 */
+	for (i = 0; i < batch_count * gemm_m * gemm_k; i++)
+		mat_a[i] = (!stride_a && i >= gemm_m * gemm_k) ? mat_a[i % (gemm_m * gemm_k)] :
+			(lanes == 1) ? (rand() % gemm_k) : ((rand() & lane_mask) - (1 << (lane_width - 1)));
+	for (i = 0; i < batch_count * gemm_n * gemm_k; i++)
+		mat_b[i] = (!stride_b && i >= gemm_n * gemm_k) ? mat_b[i % (gemm_n * gemm_k)] :
+			(lanes == 1) ? (rand() % gemm_k) : ((rand() & lane_mask) - (1 << (lane_width - 1)));
+
+	/* Sparse B: every other tile of each B is pruned to zero */
+	if (sparse_b)
+		for (i = 0; i < batch_count * gemm_n * gemm_k; i++)
+			if ((((i / gemm_k) % gemm_n) / TILE_SIZE + ((i % gemm_k) / lanes) / TILE_SIZE) & 1)
+				mat_b[i] = 0;
+
+	/* 2:4 sparse B: two words of every four along K are pruned to zero,
+	 * keeping words 0 and 2 or 1 and 3 of the group in alternate rows */
+	if (sparse_24)
+		for (i = 0; i < batch_count * gemm_n * gemm_k; i++) {
+			kw = (i % gemm_k) / lanes;
+			if ((kw & 1) != ((((i / gemm_k) % gemm_n) + kw / 4) & 1))
+				mat_b[i] = 0;
+		}
 
-	for (i = 0; i < 1; i++)
-		for (j = 0; j < (gemm_m * gemm_k) + (gemm_n * gemm_k); j++)
-			in[i * in_words_adj + j] = (token_t) (rand() % gemm_k);
+	/* Pack the elements along K; the unused lanes of the last word of a row are zero */
+	for (i = 0; i < batch_count; i++) {
+		a = &mat_a[i * gemm_m * gemm_k];
+		b = &mat_b[i * gemm_n * gemm_k];
+		if (sparse_24)
+			for (n = 0; n < gemm_n; n++)
+				for (kw = 0; kw < pitch_b; kw++)
+					in[b_offset + i * stride_b + n * pitch_b + kw] = 0;
+		for (kw = 0; kw < gemm_kw; kw++) {
+			for (m = 0; m < gemm_m; m++) {
+				uint32_t word = 0;
+				for (lane = 0; lane < lanes && kw * lanes + lane < gemm_k; lane++)
+					word |= (a[m * gemm_k + kw * lanes + lane] & lane_mask) << (lane * lane_width);
+				in[a_offset + i * stride_a + m * pitch_a + kw] = word;
+			}
+			for (n = 0; n < gemm_n; n++) {
+				/* B is stored either transposed (N x K) or row-major (K x N) */
+				int b_index = transpose_b ? (kw * pitch_b + n) : (n * pitch_b + kw);
+				uint32_t word = 0;
+				for (lane = 0; lane < lanes && kw * lanes + lane < gemm_k; lane++)
+					word |= (b[n * gemm_k + kw * lanes + lane] & lane_mask) << (lane * lane_width);
+				if (sparse_24) {
+					/* Compressed rows: per tile, the kept words and then their
+					 * 2-bit positions in the group, 16 per word */
+					int v = ((kw % TILE_SIZE) / 4) * 2 + (kw % 4) / 2;
+					int chunk = n * pitch_b + (kw / TILE_SIZE) * (TILE_SIZE / 2 + TILE_SIZE / 32);
+
+					if ((kw & 1) != ((n + kw / 4) & 1))
+						continue;
+					in[b_offset + i * stride_b + chunk + v] = word;
+					in[b_offset + i * stride_b + chunk + TILE_SIZE / 2 + v / 16] |= (uint32_t) (kw % 4) << (2 * (v % 16));
+				} else {
+					in[b_offset + i * stride_b + b_index] = word;
+				}
+			}
+		}
+	}
+
+	/* With chain, B2 (gemm_p x gemm_n) after the B matrix */
+	if (chain)
+		for (i = 0; i < gemm_p * gemm_n; i++)
+			in[b2_offset + i] = rand() % gemm_n;
+
+	/* Bias vector, after the B matrices (B2 with chain) */
+	if (bias)
+		for (n = 0; n < out_cols; n++)
+			in[bias_offset + n] = (rand() % (2 * gemm_k * gemm_k)) - gemm_k * gemm_k;
 
 	checkpoint[0] = get_counter();
 
-	for (i = 0; i < 1; i++)
-        for (int m = 0; m < gemm_m; m++)
-            for (int n = 0; n < gemm_n; n++) {
-                gold[i * out_words_adj + m * gemm_n + n] = 0;
-                for (int k = 0; k < gemm_k; k++)
-                    gold[i * out_words_adj + m * gemm_n + n] +=
-                        in[i * in_words_adj + m * gemm_k + k] * in[i * in_words_adj + gemm_m * gemm_k + n * gemm_k + k];
+	/* Tile bitmap after the bias, along K first: a set bit for every tile
+	 * that may hold non-zero elements */
+	if (sparse_b) {
+		unsigned tiles_k = (gemm_kw + TILE_SIZE - 1) / TILE_SIZE;
+		unsigned tiles = ((gemm_n + TILE_SIZE - 1) / TILE_SIZE) * tiles_k;
+
+		for (i = 0; i < (tiles + 31) / 32; i++)
+			in[bitmap_offset + i] = 0;
+		for (i = 0; i < tiles; i++)
+			if (!((i / tiles_k + i % tiles_k) & 1))
+				in[bitmap_offset + i / 32] |= 1u << (i % 32);
+	}
+
+	/* Initial content of the output, scaled by beta and accumulated into */
+	if (beta)
+		for (i = 0; i < batch_count; i++)
+			for (m = 0; m < gemm_m; m++)
+				for (n = 0; n < gemm_n; n++)
+					in[c_offset + i * stride_c + m * pitch_c + n] = (rand() % (2 * gemm_k * gemm_k)) - gemm_k * gemm_k;
+
+	/* the same for every job of the ring */
+	for (i = 1; beta && i < jobs; i++)
+		for (m = 0; m < out_len; m++)
+			in[c_offset + i * job_len + m] = in[c_offset + m];
+
+	/* Golden output, wrapping around like the 32-bit accumulators */
+	for (i = 0; i < batch_count; i++) {
+		a = &mat_a[i * gemm_m * gemm_k];
+		b = &mat_b[i * gemm_n * gemm_k];
+		for (m = 0; m < gemm_m; m++)
+			for (n = 0; n < gemm_n; n++) {
+				uint32_t acc = 0;
+				for (k = 0; k < gemm_k; k++)
+					acc += (uint32_t) (a[m * gemm_k + k] * b[n * gemm_k + k]);
+				acc = acc * alpha + (beta ? (uint32_t) in[c_offset + i * stride_c + m * pitch_c + n] * beta : 0);
+				if (chain)
+					mid[m * gemm_n + n] = activate(acc);
+				else
+					gold[i * stride_c + m * pitch_c + n] = epilogue(acc, bias ? in[bias_offset + n] : 0);
 			}
+	}
+
+	/* D = act(A x B) x B2, through the intermediate kept on chip */
+	for (m = 0; m < gemm_m && chain; m++)
+		for (n = 0; n < gemm_p; n++) {
+			uint32_t acc = 0;
+			for (k = 0; k < gemm_n; k++)
+				acc += (uint32_t) (mid[m * gemm_n + k] * in[b2_offset + n * gemm_n + k]);
+			gold[m * pitch_c + n] = epilogue(acc, bias ? in[bias_offset + n] : 0);
+		}
 
 	checkpoint[1] = get_counter();
+
+	aligned_free(mat_a);
+	aligned_free(mat_b);
+	if (chain)
+		aligned_free(mid);
+}
+
+
+/* Fill in the descriptor ring from the configuration, each job with its own
+ * output, and clear the status words */
+static void init_ring(token_t *mem)
+{
+	int i, j;
+
+	for (i = 0; i < jobs; i++) {
+		token_t *desc = &mem[desc_offset + i * DESC_WORDS];
+		token_t fields[DESC_FIELDS] = {
+			gemm_m, gemm_n, gemm_k, transpose_b, precision,
+			bias, activation, clamp_min, clamp_max, rq_scale, rq_shift,
+			alpha, beta, batch_count, stride_a, stride_b, stride_c,
+			lda, ldb, ldc, a_offset, b_offset, c_offset + i * job_len,
+			sparse_b, sparse_24, perf && i == jobs - 1, chain, gemm_p, b2_offset
+		};
+
+		for (j = 0; j < DESC_WORDS; j++)
+			desc[j] = (j < DESC_FIELDS) ? fields[j] : 0;
+	}
 }
 
 
@@ -119,19 +400,79 @@ int main(int argc, char * argv[])
 	unsigned errors = 0;
 	unsigned coherence;
 
+	/* K is counted in 32-bit words, each packing 1, 2 or 4 elements */
+	gemm_kw = (gemm_k + (1 << precision) - 1) >> precision;
+
+	/* Row pitches, 0 for packed rows */
+	pitch_a = lda ? lda : gemm_kw;
+	pitch_b = ldb ? ldb : sparse_24 ? ((gemm_kw + TILE_SIZE - 1) / TILE_SIZE) * (TILE_SIZE / 2 + TILE_SIZE / 32) :
+		(transpose_b ? gemm_n : gemm_kw);
+	out_cols = chain ? gemm_p : gemm_n;
+	pitch_c = ldc ? ldc : out_cols;
+
+	/* Batch strides, -1 for matrices packed back to back */
+	if (stride_a < 0)
+		stride_a = gemm_m * pitch_a;
+	if (stride_b < 0)
+		stride_b = (transpose_b ? gemm_kw : gemm_n) * pitch_b;
+	if (stride_c < 0)
+		stride_c = gemm_m * pitch_c;
+
+	/* All the A matrices of the batch, then all the B matrices */
+	a_offset = 0;
+	b_offset = a_offset + ((batch_count - 1) * stride_a) + (gemm_m * pitch_a);
 	if (DMA_WORD_PER_BEAT(sizeof(token_t)) == 0) {
-		in_words_adj = (gemm_m * gemm_k) + (gemm_n * gemm_k);
-		out_words_adj = gemm_m * gemm_n;
+		in_words_adj = b_offset + ((batch_count - 1) * stride_b) + ((transpose_b ? gemm_kw : gemm_n) * pitch_b);
+		out_words_adj = ((batch_count - 1) * stride_c) + (gemm_m * pitch_c);
 	} else {
-		in_words_adj = round_up((gemm_m * gemm_k) + (gemm_n * gemm_k), DMA_WORD_PER_BEAT(sizeof(token_t)));
-		out_words_adj = round_up(gemm_m * gemm_n, DMA_WORD_PER_BEAT(sizeof(token_t)));
+		in_words_adj = round_up(b_offset + ((batch_count - 1) * stride_b) + ((transpose_b ? gemm_kw : gemm_n) * pitch_b),
+					DMA_WORD_PER_BEAT(sizeof(token_t)));
+		out_words_adj = round_up(((batch_count - 1) * stride_c) + (gemm_m * pitch_c), DMA_WORD_PER_BEAT(sizeof(token_t)));
 	}
+
+	/* With chain, B2 follows the B matrix, beat aligned */
+	b2_offset = in_words_adj;
+	if (chain && DMA_WORD_PER_BEAT(sizeof(token_t)) == 0)
+		in_words_adj += gemm_p * gemm_n;
+	else if (chain)
+		in_words_adj = round_up(in_words_adj + gemm_p * gemm_n, DMA_WORD_PER_BEAT(sizeof(token_t)));
+
+	/* The bias vector follows the B matrices (B2 with chain), beat aligned */
+	bias_offset = in_words_adj;
+	if (bias && DMA_WORD_PER_BEAT(sizeof(token_t)) == 0)
+		in_words_adj += out_cols;
+	else if (bias)
+		in_words_adj = round_up(in_words_adj + out_cols, DMA_WORD_PER_BEAT(sizeof(token_t)));
+
+	/* The tile bitmap of B follows the bias, beat aligned */
+	bitmap_offset = in_words_adj;
+	if (sparse_b && DMA_WORD_PER_BEAT(sizeof(token_t)) == 0)
+		in_words_adj += ((gemm_n + TILE_SIZE - 1) / TILE_SIZE * ((gemm_kw + TILE_SIZE - 1) / TILE_SIZE) + 31) / 32;
+	else if (sparse_b)
+		in_words_adj = round_up(in_words_adj + ((gemm_n + TILE_SIZE - 1) / TILE_SIZE * ((gemm_kw + TILE_SIZE - 1) / TILE_SIZE) + 31) / 32,
+					DMA_WORD_PER_BEAT(sizeof(token_t)));
+
 	in_len = in_words_adj * (1);
 	out_len = out_words_adj * (1);
 	in_size = in_len * sizeof(token_t);
 	out_size = out_len * sizeof(token_t);
-	out_offset  = in_len;
-	mem_size = (out_offset * sizeof(token_t)) + out_size;
+	c_offset = in_len;
+	mem_size = (c_offset * sizeof(token_t)) + out_size;
+
+	/* The performance counters follow the output, beat aligned */
+	perf_offset = c_offset + out_len;
+	if (perf)
+		mem_size += PERF_WORDS * sizeof(token_t);
+
+	/* With jobs, the GEMM runs once per job of the ring, each job writing its
+	 * own copy of the output followed by room for the counters (of the last
+	 * job only); the descriptors come after the outputs */
+	job_len = out_len + PERF_WORDS;
+	if (jobs) {
+		desc_offset = c_offset + jobs * job_len;
+		perf_offset = c_offset + (jobs - 1) * job_len + out_len;
+		mem_size = (desc_offset + jobs * DESC_WORDS) * sizeof(token_t);
+	}
 
 
 	// Search for the device
@@ -183,6 +524,7 @@ int main(int argc, char * argv[])
 			printf("  --------------------\n");
 			printf("  Generate input...\n");
 			init_buf(mem, gold);
+			init_ring(mem);
 
 			// Pass common configuration parameters
 
@@ -206,6 +548,35 @@ int main(int argc, char * argv[])
 		iowrite32(dev, GEMM_ACCELERATOR_GEMM_M_REG, gemm_m);
 		iowrite32(dev, GEMM_ACCELERATOR_GEMM_N_REG, gemm_n);
 		iowrite32(dev, GEMM_ACCELERATOR_GEMM_K_REG, gemm_k);
+		iowrite32(dev, GEMM_ACCELERATOR_TRANSPOSE_B_REG, transpose_b);
+		iowrite32(dev, GEMM_ACCELERATOR_PRECISION_REG, precision);
+		iowrite32(dev, GEMM_ACCELERATOR_BIAS_REG, bias);
+		iowrite32(dev, GEMM_ACCELERATOR_ACTIVATION_REG, activation);
+		iowrite32(dev, GEMM_ACCELERATOR_CLAMP_MIN_REG, clamp_min);
+		iowrite32(dev, GEMM_ACCELERATOR_CLAMP_MAX_REG, clamp_max);
+		iowrite32(dev, GEMM_ACCELERATOR_RQ_SCALE_REG, rq_scale);
+		iowrite32(dev, GEMM_ACCELERATOR_RQ_SHIFT_REG, rq_shift);
+		iowrite32(dev, GEMM_ACCELERATOR_ALPHA_REG, alpha);
+		iowrite32(dev, GEMM_ACCELERATOR_BETA_REG, beta);
+		iowrite32(dev, GEMM_ACCELERATOR_BATCH_COUNT_REG, batch_count);
+		iowrite32(dev, GEMM_ACCELERATOR_STRIDE_A_REG, stride_a);
+		iowrite32(dev, GEMM_ACCELERATOR_STRIDE_B_REG, stride_b);
+		iowrite32(dev, GEMM_ACCELERATOR_STRIDE_C_REG, stride_c);
+		iowrite32(dev, GEMM_ACCELERATOR_LDA_REG, lda);
+		iowrite32(dev, GEMM_ACCELERATOR_LDB_REG, ldb);
+		iowrite32(dev, GEMM_ACCELERATOR_LDC_REG, ldc);
+		iowrite32(dev, GEMM_ACCELERATOR_A_OFFSET_REG, a_offset);
+		iowrite32(dev, GEMM_ACCELERATOR_B_OFFSET_REG, b_offset);
+		iowrite32(dev, GEMM_ACCELERATOR_C_OFFSET_REG, c_offset);
+		iowrite32(dev, GEMM_ACCELERATOR_SPARSE_B_REG, sparse_b);
+		iowrite32(dev, GEMM_ACCELERATOR_SPARSE_24_REG, sparse_24);
+		iowrite32(dev, GEMM_ACCELERATOR_PERF_REG, perf);
+		iowrite32(dev, GEMM_ACCELERATOR_CHAIN_REG, chain);
+		iowrite32(dev, GEMM_ACCELERATOR_GEMM_P_REG, gemm_p);
+		iowrite32(dev, GEMM_ACCELERATOR_B2_OFFSET_REG, b2_offset);
+		iowrite32(dev, GEMM_ACCELERATOR_JOBS_REG, jobs);
+		iowrite32(dev, GEMM_ACCELERATOR_DESC_OFFSET_REG, desc_offset);
+		iowrite32(dev, GEMM_ACCELERATOR_NOTIFY_REG, notify);
 
 			// Flush (customize coherence model here)
 			esp_flush(coherence);
@@ -231,7 +602,15 @@ int main(int argc, char * argv[])
 			printf("  validating...\n");
 
 			/* Validation */
-			errors = validate_buf(&mem[out_offset], gold);
+			errors = validate_buf(&mem[c_offset], gold);
+
+			/* every job of the ring, and its status word (of the last
+			 * job only without notify) */
+			for (i = 1; i < jobs; i++)
+				errors += validate_buf(&mem[c_offset + i * job_len], gold);
+			for (i = 0; i < jobs; i++)
+				if (mem[desc_offset + i * DESC_WORDS + DESC_STATUS] != ((notify || i == jobs - 1) ? i + 1 : 0))
+					errors++;
 			if (errors)
 				printf("  ... FAIL\n");
 			else
@@ -239,6 +618,16 @@ int main(int argc, char * argv[])
 	
 			printf("Time take by CPU = %d\n", checkpoint[1] - checkpoint[0]);
 			printf("Time take by acc = %d\n", checkpoint[3] - checkpoint[2]);
+
+			if (perf) {
+				token_t *counters = &mem[perf_offset];
+
+				printf("  load: %u cycles busy, %u stalled on compute\n", counters[0], counters[1]);
+				printf("  compute: %u cycles busy, %u stalled on load, %u stalled on store\n",
+				       counters[2], counters[3], counters[4]);
+				printf("  store: %u cycles busy\n", counters[5]);
+				printf("  DMA beats: %u read, %u written\n", counters[6], counters[7]);
+			}
 		}
 		aligned_free(ptable);
 		aligned_free(mem);
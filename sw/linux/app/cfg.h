@@ -12,30 +12,147 @@ typedef int32_t token_t;
 #define GEMM_M 64
 #define GEMM_N 64
 #define GEMM_K 64
+#define TRANSPOSE_B 0
+/* 0: int32, 1: 2 x int16 per word, 2: 4 x int8 per word */
+#define PRECISION 0
+/* 1: add the per-column bias vector stored after the inputs */
+#define BIAS 0
+/* 0: none, 1: ReLU, 2: clamp to [CLAMP_MIN, CLAMP_MAX] */
+#define ACTIVATION 0
+#define CLAMP_MIN 0
+#define CLAMP_MAX 0
+/* Requantization to int8, (x * RQ_SCALE) >> RQ_SHIFT, off when RQ_SCALE is 0 */
+#define RQ_SCALE 0
+#define RQ_SHIFT 0
+/* C = ALPHA * A x B + BETA * C, in the accumulator format: one is
+ * GEMM_ACCELERATOR_STRATUS_ONE_INT (_FX, _BF16) */
+#define ALPHA GEMM_ACCELERATOR_STRATUS_ONE_INT
+/* BETA != 0 reads C from the output buffer */
+#define BETA 0
+/* Number of GEMMs in the batch */
+#define BATCH_COUNT 1
+/* Row pitch of A (B, C) in words, 0 for packed rows; LDC must be beat aligned */
+#define LDA 0
+#define LDB 0
+#define LDC 0
+/* Words between the A (B, C) matrices of consecutive batches, packed back to
+ * back by default (at the row pitches above); 0 reuses the same A (B).
+ * STRIDE_C must be beat aligned */
+#define GEMM_KW ((GEMM_K + (1 << PRECISION) - 1) >> PRECISION)
+#define PITCH_A (LDA ? LDA : GEMM_KW)
+#define PITCH_B (LDB ? LDB : SPARSE_24 ? ((GEMM_KW + TILE_SIZE - 1) / TILE_SIZE) * (TILE_SIZE / 2 + TILE_SIZE / 32) : \
+		 TRANSPOSE_B ? GEMM_N : GEMM_KW)
+#define PITCH_C (LDC ? LDC : CHAIN ? GEMM_P : GEMM_N)
+#define STRIDE_A (GEMM_M * PITCH_A)
+#define STRIDE_B ((TRANSPOSE_B ? GEMM_KW : GEMM_N) * PITCH_B)
+#define STRIDE_C (GEMM_M * PITCH_C)
+/* Skip the B tiles cleared in the tile bitmap (after the bias) */
+#define SPARSE_B 0
+/* B is 2:4 sparse, in the compressed format (needs SPARSE_24 hardware) */
+#define SPARSE_24 0
+/* 1: write the performance counters after the output */
+#define PERF 0
+/* 1: D = act(A x B) x B2 on chip, with GEMM_N <= TILE_SIZE (needs GEMM_CHAIN hardware) */
+#define CHAIN 0
+/* Columns of D, and rows of B2 (stored GEMM_P x GEMM_N) */
+#define GEMM_P 64
+/* Jobs in the descriptor ring, run back to back (0: no ring). The app also
+ * runs them one ioctl each, and compares the time per job. With COHERENCE
+ * ACC_COH_FULL, it reaps each job while the ring runs */
+#define JOBS 0
+/* 1: write the status word of every job, 0: of the last one only */
+#define NOTIFY 0
+/* Edge of the tiles in the bitmap and of the 2:4 compressed rows, the
+ * BLOCK_SIZE of the accelerator */
+#define TILE_SIZE 64
+/* DMA width of the accelerator in bits (64, 128 or 256), which may be wider
+ * than the CPU: the bias, the bitmap and the output start on its beats */
+#define ACC_DMA_WIDTH 64
+/* Coherence of the accelerator DMA with the CPU caches: ACC_COH_NONE,
+ * ACC_COH_LLC, ACC_COH_RECALL or ACC_COH_FULL */
+#define COHERENCE ACC_COH_NONE
 
 /* <<--params-->> */
 const int32_t gemm_m = GEMM_M;
 const int32_t gemm_n = GEMM_N;
 const int32_t gemm_k = GEMM_K;
+const int32_t transpose_b = TRANSPOSE_B;
+const int32_t precision = PRECISION;
+const int32_t bias = BIAS;
+const int32_t activation = ACTIVATION;
+const int32_t clamp_min = CLAMP_MIN;
+const int32_t clamp_max = CLAMP_MAX;
+const int32_t rq_scale = RQ_SCALE;
+const int32_t rq_shift = RQ_SHIFT;
+const int32_t alpha = ALPHA;
+const int32_t beta = BETA;
+const int32_t batch_count = BATCH_COUNT;
+const int32_t stride_a = STRIDE_A;
+const int32_t stride_b = STRIDE_B;
+const int32_t stride_c = STRIDE_C;
+const int32_t lda = LDA;
+const int32_t ldb = LDB;
+const int32_t ldc = LDC;
+const int32_t sparse_b = SPARSE_B;
+const int32_t sparse_24 = SPARSE_24;
+const int32_t perf = PERF;
+const int32_t chain = CHAIN;
+const int32_t gemm_p = GEMM_P;
+const int32_t jobs = JOBS;
+const int32_t notify = NOTIFY;
 
-#define NACC 1
+/* Most accelerator instances (gemm_accelerator_stratus.0 .. NACC - 1) the GEMM
+ * is split across; the app uses the ones present. Entry 0 below describes the
+ * whole GEMM, the app fills in one entry per part */
+#define NACC 4
 
-struct gemm_accelerator_stratus_access gemm_accelerator_cfg_000[] = {
+struct gemm_accelerator_stratus_access gemm_accelerator_cfg_000[NACC] = {
 	{
 		/* <<--descriptor-->> */
 		.gemm_m = GEMM_M,
 		.gemm_n = GEMM_N,
 		.gemm_k = GEMM_K,
+		.transpose_b = TRANSPOSE_B,
+		.precision = PRECISION,
+		.bias = BIAS,
+		.activation = ACTIVATION,
+		.clamp_min = CLAMP_MIN,
+		.clamp_max = CLAMP_MAX,
+		.rq_scale = RQ_SCALE,
+		.rq_shift = RQ_SHIFT,
+		.alpha = ALPHA,
+		.beta = BETA,
+		.batch_count = BATCH_COUNT,
+		.stride_a = STRIDE_A,
+		.stride_b = STRIDE_B,
+		.stride_c = STRIDE_C,
+		.lda = LDA,
+		.ldb = LDB,
+		.ldc = LDC,
+		/* Operand placement in the buffer, filled in by the app */
+		.a_offset = 0,
+		.b_offset = 0,
+		.c_offset = 0,
+		.sparse_b = SPARSE_B,
+		.sparse_24 = SPARSE_24,
+		.perf = PERF,
+		.chain = CHAIN,
+		.gemm_p = GEMM_P,
+		/* filled in by the app */
+		.b2_offset = 0,
+		.jobs = JOBS,
+		.desc_offset = 0,
+		.notify = NOTIFY,
 		.src_offset = 0,
 		.dst_offset = 0,
-		.esp.coherence = ACC_COH_NONE,
+		.esp.coherence = COHERENCE,
 		.esp.p2p_store = 0,
 		.esp.p2p_nsrcs = 0,
 		.esp.p2p_srcs = {"", "", "", ""},
 	}
 };
 
-esp_thread_info_t cfg_000[] = {
+esp_thread_info_t cfg_000[NACC] = {
 	{
 		.run = true,
 		.devname = "gemm_accelerator_stratus.0",
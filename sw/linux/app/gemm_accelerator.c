@@ -3,14 +3,51 @@
 #include "libesp.h"
 #include "cfg.h"
 
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Words per beat of the accelerator DMA (see ACC_DMA_WIDTH) */
+#define ACC_WORD_PER_BEAT(_st) ((ACC_DMA_WIDTH / 8) / (_st))
+
+/* Performance counters written after the output with PERF: cycles of load
+ * busy and stalled on compute, of compute busy and stalled on load and on
+ * store, of store busy, then the DMA beats read and written */
+#define PERF_WORDS 8
+
+/* Descriptor ring with JOBS (see gemm_accelerator_stratus.h) */
+#define DESC_FIELDS GEMM_ACCELERATOR_STRATUS_DESC_FIELDS
+#define DESC_STATUS GEMM_ACCELERATOR_STRATUS_DESC_STATUS
+#define DESC_WORDS GEMM_ACCELERATOR_STRATUS_DESC_WORDS
+
+static unsigned gemm_kw;
+static unsigned out_cols;
+static unsigned pitch_a;
+static unsigned pitch_b;
+static unsigned pitch_c;
+static unsigned a_offset;
+static unsigned b_offset;
+static unsigned b2_offset;
+static unsigned desc_offset;
 static unsigned in_words_adj;
+static unsigned bias_offset;
+static unsigned bitmap_offset;
 static unsigned out_words_adj;
 static unsigned in_len;
 static unsigned out_len;
 static unsigned in_size;
 static unsigned out_size;
-static unsigned out_offset;
+static unsigned c_offset;
+static unsigned perf_offset;
+static unsigned job_len;
+static struct gemm_accelerator_stratus_access job_descs[JOBS ? JOBS : 1];
+static atomic_bool ring_done;
 static unsigned size;
+static unsigned nparts;
+static char devnames[NACC][64];
 
 /* User-defined code */
 static int validate_buffer(token_t *out, token_t *gold)
@@ -19,58 +56,462 @@ static int validate_buffer(token_t *out, token_t *gold)
 	int j;
 	unsigned errors = 0;
 
-	for (i = 0; i < 1; i++)
-		for (j = 0; j < gemm_m * gemm_n; j++)
-			if (gold[i * out_words_adj + j] != out[i * out_words_adj + j])
+	for (i = 0; i < batch_count; i++)
+		for (j = 0; j < gemm_m * out_cols; j++)
+			if (gold[i * stride_c + (j / out_cols) * pitch_c + (j % out_cols)] !=
+			    out[i * stride_c + (j / out_cols) * pitch_c + (j % out_cols)])
 				errors++;
 
 	return errors;
 }
 
 
+/* ReLU or clamp, also applied to the intermediate of a chain */
+static int32_t activate(int32_t value)
+{
+	if (activation == 1 && value < 0)
+		value = 0;
+	if (activation == 2)
+		value = (value < clamp_min) ? clamp_min : ((value > clamp_max) ? clamp_max : value);
+
+	return value;
+}
+
+
+/* Bias, activation and requantization, as applied by the store phase */
+static token_t epilogue(uint32_t acc, token_t bias_word)
+{
+	int32_t value = activate(bias ? (int32_t) (acc + bias_word) : (int32_t) acc);
+	int64_t scaled;
+
+	/* Requantization to int8: scale, round half up, shift and saturate */
+	if (rq_scale != 0) {
+		scaled = (int64_t) value * rq_scale;
+		if (rq_shift > 0)
+			scaled += (int64_t) 1 << (rq_shift - 1);
+		scaled >>= rq_shift;
+		value = (scaled < -128) ? -128 : ((scaled > 127) ? 127 : scaled);
+	}
+
+	return value;
+}
+
+
+static void print_perf(token_t *counters)
+{
+	printf("  load: %u cycles busy, %u stalled on compute\n", counters[0], counters[1]);
+	printf("  compute: %u cycles busy, %u stalled on load, %u stalled on store\n",
+	       counters[2], counters[3], counters[4]);
+	printf("  store: %u cycles busy\n", counters[5]);
+	printf("  DMA beats: %u read, %u written\n", counters[6], counters[7]);
+}
+
+
 /* User-defined code */
 static void init_buffer(token_t *in, token_t * gold)
 {
 	int i;
-	int j;
+	int m, n, k, kw, lane;
+	unsigned lanes = 1 << precision;
+	unsigned lane_width = 32 / lanes;
+	unsigned lane_mask = (lane_width == 32) ? 0xffffffff : ((1u << lane_width) - 1);
+	int32_t *mat_a = malloc(batch_count * gemm_m * gemm_k * sizeof(int32_t));
+	int32_t *mat_b = malloc(batch_count * gemm_n * gemm_k * sizeof(int32_t));
+	int32_t *mid = chain ? malloc(gemm_m * gemm_n * sizeof(int32_t)) : NULL;
+	int32_t *a, *b;
+
+	/* Matrix elements (B as N x K) of every batch: full-range signed values when
+	 * packed; a matrix shared by the batch (zero stride) is the one of batch 0 */
+	for (i = 0; i < batch_count * gemm_m * gemm_k; i++)
+		mat_a[i] = (!stride_a && i >= gemm_m * gemm_k) ? mat_a[i % (gemm_m * gemm_k)] :
+			(lanes == 1) ? (rand() % gemm_k) : ((rand() & lane_mask) - (1 << (lane_width - 1)));
+	for (i = 0; i < batch_count * gemm_n * gemm_k; i++)
+		mat_b[i] = (!stride_b && i >= gemm_n * gemm_k) ? mat_b[i % (gemm_n * gemm_k)] :
+			(lanes == 1) ? (rand() % gemm_k) : ((rand() & lane_mask) - (1 << (lane_width - 1)));
+
+	/* Sparse B: every other tile of each B is pruned to zero */
+	if (sparse_b)
+		for (i = 0; i < batch_count * gemm_n * gemm_k; i++)
+			if ((((i / gemm_k) % gemm_n) / TILE_SIZE + ((i % gemm_k) / lanes) / TILE_SIZE) & 1)
+				mat_b[i] = 0;
+
+	/* 2:4 sparse B: two words of every four along K are pruned to zero,
+	 * keeping words 0 and 2 or 1 and 3 of the group in alternate rows */
+	if (sparse_24)
+		for (i = 0; i < batch_count * gemm_n * gemm_k; i++) {
+			kw = (i % gemm_k) / lanes;
+			if ((kw & 1) != ((((i / gemm_k) % gemm_n) + kw / 4) & 1))
+				mat_b[i] = 0;
+		}
+
+	/* Pack the elements along K; the unused lanes of the last word of a row are zero */
+	for (i = 0; i < batch_count; i++) {
+		a = &mat_a[i * gemm_m * gemm_k];
+		b = &mat_b[i * gemm_n * gemm_k];
+		if (sparse_24)
+			for (n = 0; n < gemm_n; n++)
+				for (kw = 0; kw < pitch_b; kw++)
+					in[b_offset + i * stride_b + n * pitch_b + kw] = 0;
+		for (kw = 0; kw < gemm_kw; kw++) {
+			for (m = 0; m < gemm_m; m++) {
+				uint32_t word = 0;
+				for (lane = 0; lane < lanes && kw * lanes + lane < gemm_k; lane++)
+					word |= (a[m * gemm_k + kw * lanes + lane] & lane_mask) << (lane * lane_width);
+				in[a_offset + i * stride_a + m * pitch_a + kw] = word;
+			}
+			for (n = 0; n < gemm_n; n++) {
+				/* B is stored either transposed (N x K) or row-major (K x N) */
+				int b_index = transpose_b ? (kw * pitch_b + n) : (n * pitch_b + kw);
+				uint32_t word = 0;
+				for (lane = 0; lane < lanes && kw * lanes + lane < gemm_k; lane++)
+					word |= (b[n * gemm_k + kw * lanes + lane] & lane_mask) << (lane * lane_width);
+				if (sparse_24) {
+					/* Compressed rows: per tile, the kept words and then their
+					 * 2-bit positions in the group, 16 per word */
+					int v = ((kw % TILE_SIZE) / 4) * 2 + (kw % 4) / 2;
+					int chunk = n * pitch_b + (kw / TILE_SIZE) * (TILE_SIZE / 2 + TILE_SIZE / 32);
 
-	for (i = 0; i < 1; i++)
-		for (j = 0; j < (gemm_m * gemm_k) + (gemm_n * gemm_k); j++)
-			in[i * in_words_adj + j] = (token_t) (rand() % gemm_k);
-
-	for (i = 0; i < 1; i++)
-        for (int m = 0; m < gemm_m; m++)
-            for (int n = 0; n < gemm_n; n++) {
-                gold[i * out_words_adj + m * gemm_n + n] = 0;
-                for (int k = 0; k < gemm_k; k++)
-                    gold[i * out_words_adj + m * gemm_n + n] +=
-                        in[i * in_words_adj + m * gemm_k + k] * in[i * in_words_adj + gemm_m * gemm_k + n * gemm_k + k];
+					if ((kw & 1) != ((n + kw / 4) & 1))
+						continue;
+					in[b_offset + i * stride_b + chunk + v] = word;
+					in[b_offset + i * stride_b + chunk + TILE_SIZE / 2 + v / 16] |= (uint32_t) (kw % 4) << (2 * (v % 16));
+				} else {
+					in[b_offset + i * stride_b + b_index] = word;
+				}
 			}
+		}
+	}
+
+	/* With chain, B2 (GEMM_P x GEMM_N) after the B matrix */
+	if (chain)
+		for (i = 0; i < gemm_p * gemm_n; i++)
+			in[b2_offset + i] = rand() % gemm_n;
+
+	/* Bias vector, after the B matrices (B2 with chain) */
+	if (bias)
+		for (n = 0; n < out_cols; n++)
+			in[bias_offset + n] = (rand() % (2 * gemm_k * gemm_k)) - gemm_k * gemm_k;
+
+	/* Tile bitmap after the bias, along K first: a set bit for every tile
+	 * that may hold non-zero elements */
+	if (sparse_b) {
+		unsigned tiles_k = (gemm_kw + TILE_SIZE - 1) / TILE_SIZE;
+		unsigned tiles = ((gemm_n + TILE_SIZE - 1) / TILE_SIZE) * tiles_k;
+
+		for (i = 0; i < (tiles + 31) / 32; i++)
+			in[bitmap_offset + i] = 0;
+		for (i = 0; i < tiles; i++)
+			if (!((i / tiles_k + i % tiles_k) & 1))
+				in[bitmap_offset + i / 32] |= 1u << (i % 32);
+	}
+
+	/* Initial content of the output, scaled by beta and accumulated into (the
+	 * same for every job of the ring) */
+	if (beta)
+		for (i = 0; i < batch_count; i++)
+			for (m = 0; m < gemm_m; m++)
+				for (n = 0; n < gemm_n; n++)
+					in[c_offset + i * stride_c + m * pitch_c + n] = (rand() % (2 * gemm_k * gemm_k)) - gemm_k * gemm_k;
+	for (i = 1; beta && i < jobs; i++)
+		memcpy(&in[c_offset + i * job_len], &in[c_offset], out_size);
+
+	/* Golden output, wrapping around like the 32-bit accumulators */
+	for (i = 0; i < batch_count; i++) {
+		a = &mat_a[i * gemm_m * gemm_k];
+		b = &mat_b[i * gemm_n * gemm_k];
+		for (m = 0; m < gemm_m; m++)
+			for (n = 0; n < gemm_n; n++) {
+				uint32_t acc = 0;
+				for (k = 0; k < gemm_k; k++)
+					acc += (uint32_t) (a[m * gemm_k + k] * b[n * gemm_k + k]);
+				acc = acc * alpha + (beta ? (uint32_t) in[c_offset + i * stride_c + m * pitch_c + n] * beta : 0);
+				if (chain)
+					mid[m * gemm_n + n] = activate(acc);
+				else
+					gold[i * stride_c + m * pitch_c + n] = epilogue(acc, bias ? in[bias_offset + n] : 0);
+			}
+	}
+
+	/* D = act(A x B) x B2, through the intermediate kept on chip */
+	for (m = 0; m < gemm_m && chain; m++)
+		for (n = 0; n < gemm_p; n++) {
+			uint32_t acc = 0;
+			for (k = 0; k < gemm_n; k++)
+				acc += (uint32_t) (mid[m * gemm_n + k] * in[b2_offset + n * gemm_n + k]);
+			gold[m * pitch_c + n] = epilogue(acc, bias ? in[bias_offset + n] : 0);
+		}
+
+	free(mat_a);
+	free(mat_b);
+	free(mid);
 }
 
 
 /* User-defined code */
 static void init_parameters()
 {
-	if (DMA_WORD_PER_BEAT(sizeof(token_t)) == 0) {
-		in_words_adj = (gemm_m * gemm_k) + (gemm_n * gemm_k);
-		out_words_adj = gemm_m * gemm_n;
+	/* K is counted in 32-bit words, each packing 1, 2 or 4 elements */
+	gemm_kw = (gemm_k + (1 << precision) - 1) >> precision;
+
+	/* Row pitches, 0 for packed rows */
+	pitch_a = lda ? lda : gemm_kw;
+	pitch_b = ldb ? ldb : sparse_24 ? ((gemm_kw + TILE_SIZE - 1) / TILE_SIZE) * (TILE_SIZE / 2 + TILE_SIZE / 32) :
+		(transpose_b ? gemm_n : gemm_kw);
+	out_cols = chain ? gemm_p : gemm_n;
+	pitch_c = ldc ? ldc : out_cols;
+
+	/* All the A matrices of the batch, then all the B matrices */
+	a_offset = 0;
+	b_offset = a_offset + ((batch_count - 1) * stride_a) + (gemm_m * pitch_a);
+	if (ACC_WORD_PER_BEAT(sizeof(token_t)) == 0) {
+		in_words_adj = b_offset + ((batch_count - 1) * stride_b) + ((transpose_b ? gemm_kw : gemm_n) * pitch_b);
+		out_words_adj = ((batch_count - 1) * stride_c) + (gemm_m * pitch_c);
 	} else {
-		in_words_adj = round_up((gemm_m * gemm_k) + (gemm_n * gemm_k), DMA_WORD_PER_BEAT(sizeof(token_t)));
-		out_words_adj = round_up(gemm_m * gemm_n, DMA_WORD_PER_BEAT(sizeof(token_t)));
+		in_words_adj = round_up(b_offset + ((batch_count - 1) * stride_b) + ((transpose_b ? gemm_kw : gemm_n) * pitch_b),
+					ACC_WORD_PER_BEAT(sizeof(token_t)));
+		out_words_adj = round_up(((batch_count - 1) * stride_c) + (gemm_m * pitch_c), ACC_WORD_PER_BEAT(sizeof(token_t)));
 	}
+
+	/* With chain, B2 follows the B matrix, beat aligned */
+	b2_offset = in_words_adj;
+	if (chain && ACC_WORD_PER_BEAT(sizeof(token_t)) == 0)
+		in_words_adj += gemm_p * gemm_n;
+	else if (chain)
+		in_words_adj = round_up(in_words_adj + gemm_p * gemm_n, ACC_WORD_PER_BEAT(sizeof(token_t)));
+
+	/* The bias vector follows the B matrices (B2 with chain), beat aligned */
+	bias_offset = in_words_adj;
+	if (bias && ACC_WORD_PER_BEAT(sizeof(token_t)) == 0)
+		in_words_adj += out_cols;
+	else if (bias)
+		in_words_adj = round_up(in_words_adj + out_cols, ACC_WORD_PER_BEAT(sizeof(token_t)));
+
+	/* The tile bitmap of B follows the bias, beat aligned */
+	bitmap_offset = in_words_adj;
+	if (sparse_b && ACC_WORD_PER_BEAT(sizeof(token_t)) == 0)
+		in_words_adj += ((gemm_n + TILE_SIZE - 1) / TILE_SIZE * ((gemm_kw + TILE_SIZE - 1) / TILE_SIZE) + 31) / 32;
+	else if (sparse_b)
+		in_words_adj = round_up(in_words_adj + ((gemm_n + TILE_SIZE - 1) / TILE_SIZE * ((gemm_kw + TILE_SIZE - 1) / TILE_SIZE) + 31) / 32,
+					ACC_WORD_PER_BEAT(sizeof(token_t)));
+
 	in_len = in_words_adj * (1);
 	out_len =  out_words_adj * (1);
 	in_size = in_len * sizeof(token_t);
 	out_size = out_len * sizeof(token_t);
-	out_offset = in_len;
-	size = (out_offset * sizeof(token_t)) + out_size;
+	c_offset = in_len;
+	size = (c_offset * sizeof(token_t)) + out_size;
+
+	/* The performance counters follow the output, beat aligned */
+	perf_offset = c_offset + out_len;
+	if (perf)
+		size += PERF_WORDS * sizeof(token_t);
+
+	/* With JOBS, the GEMM runs once per job of the ring, each job writing its
+	 * own copy of the output followed by room for the counters (of the last
+	 * job only); the descriptors come after the outputs */
+	job_len = out_len + PERF_WORDS;
+	if (jobs) {
+		desc_offset = c_offset + jobs * job_len;
+		perf_offset = c_offset + (jobs - 1) * job_len + out_len;
+		size = (desc_offset + jobs * DESC_WORDS) * sizeof(token_t);
+	}
+
+	gemm_accelerator_cfg_000[0].a_offset = a_offset;
+	gemm_accelerator_cfg_000[0].b_offset = b_offset;
+	gemm_accelerator_cfg_000[0].c_offset = c_offset;
+	gemm_accelerator_cfg_000[0].b2_offset = b2_offset;
+	gemm_accelerator_cfg_000[0].desc_offset = desc_offset;
+}
+
+
+/* Submit many: pack an array of n access descriptors into the ring, one job
+ * each, and clear the status words */
+static void pack_ring(token_t *buf, struct gemm_accelerator_stratus_access *descs, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		struct gemm_accelerator_stratus_access *a = &descs[i];
+		token_t *desc = &buf[desc_offset + i * DESC_WORDS];
+		token_t fields[DESC_FIELDS] = {
+			a->gemm_m, a->gemm_n, a->gemm_k, a->transpose_b, a->precision,
+			a->bias, a->activation, a->clamp_min, a->clamp_max, a->rq_scale, a->rq_shift,
+			a->alpha, a->beta, a->batch_count, a->stride_a, a->stride_b, a->stride_c,
+			a->lda, a->ldb, a->ldc, a->a_offset, a->b_offset, a->c_offset,
+			a->sparse_b, a->sparse_24, a->perf, a->chain, a->gemm_p, a->b2_offset
+		};
+
+		memset(desc, 0, DESC_WORDS * sizeof(token_t));
+		memcpy(desc, fields, sizeof(fields));
+	}
+}
+
+
+/* Split the GEMM across ndev instances, by whole tiles of rows of C or, when
+ * C has more tiles along N, of columns. The accelerator finds the bias and the
+ * tile bitmap after the B matrices, so a GEMM with either (or a chain, which
+ * has a single tile along N) is split by rows.
+ * Every part runs with the pitches of the whole GEMM; returns the parts */
+static unsigned partition(token_t *buf, unsigned ndev)
+{
+	struct gemm_accelerator_stratus_access whole = gemm_accelerator_cfg_000[0];
+	esp_thread_info_t thread = cfg_000[0];
+	unsigned tiles_m = (gemm_m + TILE_SIZE - 1) / TILE_SIZE;
+	unsigned tiles_n = (gemm_n + TILE_SIZE - 1) / TILE_SIZE;
+	bool by_n = (tiles_n > tiles_m) && !bias && !sparse_b && !chain;
+	unsigned tiles = by_n ? tiles_n : tiles_m;
+	unsigned dim = by_n ? gemm_n : gemm_m;
+	unsigned parts = (ndev < tiles) ? ndev : tiles;
+	unsigned first = 0;
+	unsigned i;
+
+	for (i = 0; i < parts; i++) {
+		struct gemm_accelerator_stratus_access *desc = &gemm_accelerator_cfg_000[i];
+		unsigned count = tiles / parts + (i < tiles % parts);
+		unsigned start = first * TILE_SIZE;
+		unsigned end = ((first + count) * TILE_SIZE < dim) ? (first + count) * TILE_SIZE : dim;
+
+		*desc = whole;
+		desc->lda = pitch_a;
+		desc->ldb = pitch_b;
+		desc->ldc = pitch_c;
+		if (by_n) {
+			desc->gemm_n = end - start;
+			desc->b_offset += transpose_b ? start : start * pitch_b;
+			desc->c_offset += start;
+		} else {
+			desc->gemm_m = end - start;
+			desc->a_offset += start * pitch_a;
+			desc->c_offset += start * pitch_c;
+		}
+
+		/* the counters of a part would land on the output of the next one */
+		if (parts > 1)
+			desc->perf = 0;
+
+		snprintf(devnames[i], sizeof(devnames[i]), "gemm_accelerator_stratus.%u", i);
+		cfg_000[i] = thread;
+		cfg_000[i].devname = devnames[i];
+		cfg_000[i].hw_buf = buf;
+		cfg_000[i].esp_desc = &desc->esp;
+		first += count;
+	}
+
+	return parts;
+}
+
+
+/* Instances of the accelerator present, up to NACC */
+static unsigned count_devices()
+{
+	char path[96];
+	unsigned ndev;
+
+	for (ndev = 0; ndev < NACC; ndev++) {
+		snprintf(path, sizeof(path), "/dev/gemm_accelerator_stratus.%u", ndev);
+		if (access(path, F_OK))
+			break;
+	}
+
+	return ndev ? ndev : 1;
+}
+
+
+/* Wall-clock time, to compare the submission paths */
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* Run the whole ring with a single ioctl, returning when it is done */
+static void *submit_ring(void *arg)
+{
+	esp_run(cfg_000, 1);
+	atomic_store(&ring_done, true);
+
+	return NULL;
+}
+
+
+/* Run the JOBS GEMMs one ioctl each, then all at once through the ring, and
+ * compare the time per job. The ring is submitted from another thread, and
+ * the jobs are reaped from their status words as they complete: while the
+ * ring runs if its DMA is coherent with the CPU caches, else once it is done.
+ * Returns the errors of both runs */
+static int run_jobs(token_t *buf, token_t *gold)
+{
+	struct gemm_accelerator_stratus_access *ring = &gemm_accelerator_cfg_000[0];
+	bool poll = (ring->esp.coherence == ACC_COH_FULL);
+	token_t *c_init = malloc(jobs * job_len * sizeof(token_t));
+	unsigned long long hw_ns = 0;
+	unsigned long long start, single_ns, ring_ns;
+	pthread_t submit;
+	int errors = 0;
+	unsigned i;
+
+	/* the same GEMM in every job, each into its own output */
+	for (i = 0; i < jobs; i++) {
+		job_descs[i] = *ring;
+		job_descs[i].jobs = 0;
+		job_descs[i].c_offset += i * job_len;
+		job_descs[i].perf = perf && i == jobs - 1;
+	}
+	memcpy(c_init, &buf[c_offset], jobs * job_len * sizeof(token_t));
+
+	/* One ioctl per job */
+	start = now_ns();
+	for (i = 0; i < jobs; i++) {
+		cfg_000[0].esp_desc = &job_descs[i].esp;
+		esp_run(cfg_000, 1);
+		hw_ns += cfg_000[0].hw_ns;
+	}
+	single_ns = now_ns() - start;
+	for (i = 0; i < jobs; i++)
+		errors += validate_buffer(&buf[c_offset + i * job_len], gold);
+
+	/* The ring, on the outputs as they were */
+	memcpy(&buf[c_offset], c_init, jobs * job_len * sizeof(token_t));
+	pack_ring(buf, job_descs, jobs);
+	cfg_000[0].esp_desc = &ring->esp;
+	atomic_store(&ring_done, false);
+
+	start = now_ns();
+	pthread_create(&submit, NULL, submit_ring, NULL);
+	for (i = 0; i < jobs; i++) {
+		/* without NOTIFY, all the jobs are reaped with the last one */
+		unsigned last = notify ? i : jobs - 1;
+		volatile token_t *status = &buf[desc_offset + last * DESC_WORDS + DESC_STATUS];
+
+		while (!atomic_load(&ring_done) && !(poll && *status == last + 1))
+			sched_yield();
+		errors += validate_buffer(&buf[c_offset + i * job_len], gold);
+	}
+	pthread_join(submit, NULL);
+	ring_ns = now_ns() - start;
+
+	for (i = 0; i < jobs; i++)
+		if (buf[desc_offset + i * DESC_WORDS + DESC_STATUS] != ((notify || i == jobs - 1) ? i + 1 : 0))
+			errors++;
+
+	printf("  one ioctl per job: %llu ns per job, %llu in the accelerator\n",
+	       single_ns / jobs, hw_ns / jobs);
+	printf("  ring of %d jobs: %llu ns per job, %llu in the accelerator\n",
+	       jobs, ring_ns / jobs, (unsigned long long) cfg_000[0].hw_ns / jobs);
+
+	free(c_init);
+
+	return errors;
 }
 
 
 int main(int argc, char **argv)
 {
 	int errors;
+	unsigned i;
 
 	token_t *gold;
 	token_t *buf;
@@ -78,7 +519,7 @@ int main(int argc, char **argv)
 	init_parameters();
 
 	buf = (token_t *) esp_alloc(size);
-	cfg_000[0].hw_buf = buf;
+	nparts = partition(buf, jobs ? 1 : count_devices());
     
 	gold = malloc(out_size);
 
@@ -89,13 +530,56 @@ int main(int argc, char **argv)
 	printf("  .gemm_m = %d\n", gemm_m);
 	printf("  .gemm_n = %d\n", gemm_n);
 	printf("  .gemm_k = %d\n", gemm_k);
+	printf("  .transpose_b = %d\n", transpose_b);
+	printf("  .precision = %d\n", precision);
+	printf("  .bias = %d\n", bias);
+	printf("  .activation = %d\n", activation);
+	printf("  .clamp_min = %d\n", clamp_min);
+	printf("  .clamp_max = %d\n", clamp_max);
+	printf("  .rq_scale = %d\n", rq_scale);
+	printf("  .rq_shift = %d\n", rq_shift);
+	printf("  .alpha = %d\n", alpha);
+	printf("  .beta = %d\n", beta);
+	printf("  .batch_count = %d\n", batch_count);
+	printf("  .stride_a = %d\n", stride_a);
+	printf("  .stride_b = %d\n", stride_b);
+	printf("  .stride_c = %d\n", stride_c);
+	printf("  .lda = %d\n", lda);
+	printf("  .ldb = %d\n", ldb);
+	printf("  .ldc = %d\n", ldc);
+	printf("  .a_offset = %d\n", a_offset);
+	printf("  .b_offset = %d\n", b_offset);
+	printf("  .c_offset = %d\n", c_offset);
+	printf("  .sparse_b = %d\n", sparse_b);
+	printf("  .sparse_24 = %d\n", sparse_24);
+	printf("  .perf = %d\n", perf);
+	printf("  .chain = %d\n", chain);
+	printf("  .gemm_p = %d\n", gemm_p);
+	printf("  .b2_offset = %d\n", b2_offset);
+	printf("  .jobs = %d\n", jobs);
+	printf("  .desc_offset = %d\n", desc_offset);
+	printf("  .notify = %d\n", notify);
+	printf("  split across %u instance(s)\n", nparts);
 	printf("\n  ** START **\n");
 
-	esp_run(cfg_000, NACC);
+	if (jobs) {
+		errors = run_jobs(buf, gold);
+
+		printf("\n  ** DONE **\n");
+	} else {
+		esp_run(cfg_000, nparts);
+
+		printf("\n  ** DONE **\n");
+
+		for (i = 0; i < nparts; i++)
+			printf("  %s: %u x %u, %llu ns\n", cfg_000[i].devname, gemm_accelerator_cfg_000[i].gemm_m,
+			       gemm_accelerator_cfg_000[i].gemm_n, (unsigned long long) cfg_000[i].hw_ns);
 
-	printf("\n  ** DONE **\n");
+		errors = validate_buffer(&buf[c_offset], gold);
+	}
 
-	errors = validate_buffer(&buf[out_offset], gold);
+	if (gemm_accelerator_cfg_000[0].perf)
+		print_perf(&buf[perf_offset]);
 
 	free(gold);
 	esp_free(buf);
@@ -16,6 +16,40 @@
 #define GEMM_ACCELERATOR_GEMM_M_REG 0x48
 #define GEMM_ACCELERATOR_GEMM_N_REG 0x44
 #define GEMM_ACCELERATOR_GEMM_K_REG 0x40
+#define GEMM_ACCELERATOR_TRANSPOSE_B_REG 0x4c
+#define GEMM_ACCELERATOR_PRECISION_REG 0x50
+#define GEMM_ACCELERATOR_BIAS_REG 0x54
+#define GEMM_ACCELERATOR_ACTIVATION_REG 0x58
+#define GEMM_ACCELERATOR_CLAMP_MIN_REG 0x5c
+#define GEMM_ACCELERATOR_CLAMP_MAX_REG 0x60
+#define GEMM_ACCELERATOR_RQ_SCALE_REG 0x64
+#define GEMM_ACCELERATOR_RQ_SHIFT_REG 0x68
+#define GEMM_ACCELERATOR_ALPHA_REG 0x6c
+#define GEMM_ACCELERATOR_BETA_REG 0x70
+#define GEMM_ACCELERATOR_BATCH_COUNT_REG 0x74
+#define GEMM_ACCELERATOR_STRIDE_A_REG 0x78
+#define GEMM_ACCELERATOR_STRIDE_B_REG 0x7c
+#define GEMM_ACCELERATOR_STRIDE_C_REG 0x80
+#define GEMM_ACCELERATOR_LDA_REG 0x84
+#define GEMM_ACCELERATOR_LDB_REG 0x88
+#define GEMM_ACCELERATOR_LDC_REG 0x8c
+#define GEMM_ACCELERATOR_A_OFFSET_REG 0x90
+#define GEMM_ACCELERATOR_B_OFFSET_REG 0x94
+#define GEMM_ACCELERATOR_C_OFFSET_REG 0x98
+#define GEMM_ACCELERATOR_SPARSE_B_REG 0x9c
+#define GEMM_ACCELERATOR_SPARSE_24_REG 0xa0
+#define GEMM_ACCELERATOR_PERF_REG 0xa4
+#define GEMM_ACCELERATOR_CHAIN_REG 0xa8
+#define GEMM_ACCELERATOR_GEMM_P_REG 0xac
+#define GEMM_ACCELERATOR_B2_OFFSET_REG 0xb0
+#define GEMM_ACCELERATOR_JOBS_REG 0xb4
+#define GEMM_ACCELERATOR_DESC_OFFSET_REG 0xb8
+#define GEMM_ACCELERATOR_NOTIFY_REG 0xbc
+
+/* Set when the accelerator is built with the 2:4 sparse datapath (SPARSE_24) */
+static bool sparse_24;
+module_param(sparse_24, bool, 0444);
+MODULE_PARM_DESC(sparse_24, "The accelerator has the 2:4 sparse datapath");
 
 struct gemm_accelerator_stratus_device {
 	struct esp_device esp;
@@ -51,6 +85,35 @@ static void gemm_accelerator_prep_xfer(struct esp_device *esp, void *arg)
 	iowrite32be(a->gemm_m, esp->iomem + GEMM_ACCELERATOR_GEMM_M_REG);
 	iowrite32be(a->gemm_n, esp->iomem + GEMM_ACCELERATOR_GEMM_N_REG);
 	iowrite32be(a->gemm_k, esp->iomem + GEMM_ACCELERATOR_GEMM_K_REG);
+	iowrite32be(a->transpose_b, esp->iomem + GEMM_ACCELERATOR_TRANSPOSE_B_REG);
+	iowrite32be(a->precision, esp->iomem + GEMM_ACCELERATOR_PRECISION_REG);
+	iowrite32be(a->bias, esp->iomem + GEMM_ACCELERATOR_BIAS_REG);
+	iowrite32be(a->activation, esp->iomem + GEMM_ACCELERATOR_ACTIVATION_REG);
+	iowrite32be(a->clamp_min, esp->iomem + GEMM_ACCELERATOR_CLAMP_MIN_REG);
+	iowrite32be(a->clamp_max, esp->iomem + GEMM_ACCELERATOR_CLAMP_MAX_REG);
+	iowrite32be(a->rq_scale, esp->iomem + GEMM_ACCELERATOR_RQ_SCALE_REG);
+	iowrite32be(a->rq_shift, esp->iomem + GEMM_ACCELERATOR_RQ_SHIFT_REG);
+	iowrite32be(a->alpha, esp->iomem + GEMM_ACCELERATOR_ALPHA_REG);
+	iowrite32be(a->beta, esp->iomem + GEMM_ACCELERATOR_BETA_REG);
+	iowrite32be(a->batch_count, esp->iomem + GEMM_ACCELERATOR_BATCH_COUNT_REG);
+	iowrite32be(a->stride_a, esp->iomem + GEMM_ACCELERATOR_STRIDE_A_REG);
+	iowrite32be(a->stride_b, esp->iomem + GEMM_ACCELERATOR_STRIDE_B_REG);
+	iowrite32be(a->stride_c, esp->iomem + GEMM_ACCELERATOR_STRIDE_C_REG);
+	iowrite32be(a->lda, esp->iomem + GEMM_ACCELERATOR_LDA_REG);
+	iowrite32be(a->ldb, esp->iomem + GEMM_ACCELERATOR_LDB_REG);
+	iowrite32be(a->ldc, esp->iomem + GEMM_ACCELERATOR_LDC_REG);
+	iowrite32be(a->a_offset, esp->iomem + GEMM_ACCELERATOR_A_OFFSET_REG);
+	iowrite32be(a->b_offset, esp->iomem + GEMM_ACCELERATOR_B_OFFSET_REG);
+	iowrite32be(a->c_offset, esp->iomem + GEMM_ACCELERATOR_C_OFFSET_REG);
+	iowrite32be(a->sparse_b, esp->iomem + GEMM_ACCELERATOR_SPARSE_B_REG);
+	iowrite32be(a->sparse_24, esp->iomem + GEMM_ACCELERATOR_SPARSE_24_REG);
+	iowrite32be(a->perf, esp->iomem + GEMM_ACCELERATOR_PERF_REG);
+	iowrite32be(a->chain, esp->iomem + GEMM_ACCELERATOR_CHAIN_REG);
+	iowrite32be(a->gemm_p, esp->iomem + GEMM_ACCELERATOR_GEMM_P_REG);
+	iowrite32be(a->b2_offset, esp->iomem + GEMM_ACCELERATOR_B2_OFFSET_REG);
+	iowrite32be(a->jobs, esp->iomem + GEMM_ACCELERATOR_JOBS_REG);
+	iowrite32be(a->desc_offset, esp->iomem + GEMM_ACCELERATOR_DESC_OFFSET_REG);
+	iowrite32be(a->notify, esp->iomem + GEMM_ACCELERATOR_NOTIFY_REG);
 	iowrite32be(a->src_offset, esp->iomem + SRC_OFFSET_REG);
 	iowrite32be(a->dst_offset, esp->iomem + DST_OFFSET_REG);
 
@@ -59,7 +122,32 @@ static void gemm_accelerator_prep_xfer(struct esp_device *esp, void *arg)
 static bool gemm_accelerator_xfer_input_ok(struct esp_device *esp, void *arg)
 {
 	/* struct gemm_accelerator_stratus_device *gemm_accelerator = to_gemm_accelerator(esp); */
-	/* struct gemm_accelerator_stratus_access *a = arg; */
+	struct gemm_accelerator_stratus_access *a = arg;
+	struct contig_desc *contig = contig_khandle_to_desc(a->esp.contig);
+	u64 words = (u64) contig->n_chunks * contig->chunk_size / sizeof(u32);
+
+	/* No P2P: the load phase also reads B (and the bias and the bitmap) from
+	 * memory, and may fetch a block of A more than once */
+	if (a->esp.p2p_store || a->esp.p2p_nsrcs)
+		return false;
+
+	/* A ring of jobs is read from the buffer, and must fit in it */
+	if (a->jobs)
+		return a->desc_offset + (u64) a->jobs * GEMM_ACCELERATOR_STRATUS_DESC_WORDS <= words;
+
+	/* Otherwise the registers describe the GEMM */
+	if (!a->gemm_m || !a->gemm_n || !a->gemm_k || !a->batch_count)
+		return false;
+	/* int32, int16 or int8; none, ReLU or clamp */
+	if (a->precision > 2 || a->activation > 2)
+		return false;
+	if (a->sparse_24 && !sparse_24)
+		return false;
+	if (a->chain && (!a->gemm_p || a->gemm_n > GEMM_ACCELERATOR_STRATUS_CHAIN_MAX_N))
+		return false;
+	/* The requantization shift is applied to a 64-bit product */
+	if (a->rq_scale && a->rq_shift > 31)
+		return false;
 
 	return true;
 }
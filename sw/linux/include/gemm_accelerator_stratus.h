@@ -23,10 +23,61 @@ struct gemm_accelerator_stratus_access {
 	unsigned gemm_m;
 	unsigned gemm_n;
 	unsigned gemm_k;
+	unsigned transpose_b;
+	unsigned precision;
+	/* No offset register: the bias follows the last B (B2 with chain),
+	 * the tile bitmap of sparse_b follows the bias, each aligned to the
+	 * next DMA beat */
+	unsigned bias;
+	unsigned activation;
+	unsigned clamp_min;
+	unsigned clamp_max;
+	unsigned rq_scale;
+	unsigned rq_shift;
+	unsigned alpha;
+	unsigned beta;
+	unsigned batch_count;
+	unsigned stride_a;
+	unsigned stride_b;
+	unsigned stride_c;
+	unsigned lda;
+	unsigned ldb;
+	unsigned ldc;
+	unsigned a_offset;
+	unsigned b_offset;
+	unsigned c_offset;
+	unsigned sparse_b;
+	unsigned sparse_24;
+	unsigned perf;
+	unsigned chain;
+	unsigned gemm_p;
+	unsigned b2_offset;
+	unsigned jobs;
+	unsigned desc_offset;
+	unsigned notify;
 	unsigned src_offset;
 	unsigned dst_offset;
 };
 
+/* Descriptor ring (jobs): per job, DESC_WORDS words at desc_offset + job *
+ * DESC_WORDS holding the gemm_m to b2_offset fields above in order, then the
+ * status word the accelerator writes when the job is done (the number of jobs
+ * done so far; with notify 0, for the last job only) */
+#define GEMM_ACCELERATOR_STRATUS_DESC_FIELDS	29
+#define GEMM_ACCELERATOR_STRATUS_DESC_STATUS	32
+#define GEMM_ACCELERATOR_STRATUS_DESC_WORDS	40
+
+/* alpha of one in the accumulator format of each datapath (integer, Q16.16
+ * fixed point, fp32). alpha has no default: the registers reset to 0, and
+ * alpha 0 gives C = beta x C */
+#define GEMM_ACCELERATOR_STRATUS_ONE_INT	1
+#define GEMM_ACCELERATOR_STRATUS_ONE_FX		(1 << 16)
+#define GEMM_ACCELERATOR_STRATUS_ONE_BF16	0x3f800000
+
+/* Largest gemm_n of a fused chain: BLOCK_SIZE of the configurations built
+ * with GEMM_CHAIN. The accelerator clamps a larger one */
+#define GEMM_ACCELERATOR_STRATUS_CHAIN_MAX_N	64
+
 #define GEMM_ACCELERATOR_STRATUS_IOC_ACCESS	_IOW ('S', 0, struct gemm_accelerator_stratus_access)
 
 #endif /* _GEMM_ACCELERATOR_STRATUS_H_ */